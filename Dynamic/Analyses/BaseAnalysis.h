@@ -9,22 +9,49 @@ struct CallBacks {
     bool FUNCTION;
     bool MEMORY_R;
     bool MEMORY_W;
+    bool PAGES = false; // Memory accesses are reported by PageWatch faults instead of instrumentation callbacks
 };
 
 template<typename T>
 class BaseAnalysis {
     protected:
         BaseAnalysis() { references.reserve(10); };
-        std::vector<void const*> references;
+        arena::vector<StackId> references;
+        uint64_t verdict_mask = 0;
+
+        // Supplier callsites statically proven for the analysed expression need no runtime state
+        inline bool isProven(CallsiteInfo const& callsite) const { return callsite.proven & verdict_mask; };
+
+        // Position of the pending supplier callsite of each call id in the analysis temporaries, -1 if none
+        arena::vector<int32_t> callsite_slots;
+        void initCallsiteSlots(void const* func_supplier) { callsite_slots.assign(DynamicUtils::getNumCalls(func_supplier), -1); };
+        inline int32_t& callsiteSlot(uint32_t call) {
+            if (call >= callsite_slots.size()) [[unlikely]] callsite_slots.resize(call + 1, -1);
+            return callsite_slots[call];
+        };
+        // Update slots after the pending callsites from idx on have moved
+        inline void reindexCallsites(arena::vector<CallsiteInfo> const& callsites, size_t idx) {
+            for (size_t i = idx; i < callsites.size(); i++) callsite_slots[callsites[i].call] = i;
+        };
+        inline void clearCallsites(arena::vector<CallsiteInfo>& callsites) {
+            for (CallsiteInfo const& callsite : callsites) callsite_slots[callsite.call] = -1;
+            callsites.clear();
+        };
     public:
+        void setVerdictBit(int32_t bit) { verdict_mask = bit < 0 ? 0 : 1ull << bit; };
+
         // Event handlers. Return non-unknown if analysis is resolved and no longer needs to be analysed.
         // onFunctionCall does not forward return address, as it is included in callsiteinfo
         inline Fulfillment onFunctionCall(CodePtr const& location, void* const& func, CallsiteInfo const& callsite) { return static_cast<T*>(this)->functionCBImpl(func, callsite); };
-        inline Fulfillment onMemoryAccess(CodePtr const& location, void const* const& memory, bool const& isWrite) { return static_cast<T*>(this)->memoryCBImpl(std::forward<CodePtr const>(location), memory, isWrite); };
+        inline Fulfillment onMemoryAccess(CodePtr const& location, SiteId const& site, void const* const& memory, bool const& isWrite) { return static_cast<T*>(this)->memoryCBImpl(std::forward<CodePtr const>(location), site, memory, isWrite); };
+        inline Fulfillment onMemoryRangeAccess(CodePtr const& location, SiteId const& site, void const* const& base, int64_t const& count, int64_t const& stride, bool const& isWrite) { return static_cast<T*>(this)->memoryRangeCBImpl(location, site, base, count, stride, isWrite); };
         inline Fulfillment onProgramExit(CodePtr const& location) { return static_cast<T*>(this)->exitCBImpl(std::forward<void const* const>(location)); };
 
         // For debugging and error output
-        inline std::vector<CodePtr> const& getReferences() { return std::move(references); };
+        inline arena::vector<StackId> const& getReferences() { return std::move(references); };
+
+        // Functions whose calls this analysis needs to see
+        arena::vector<void const*> observedFunctions() const { return static_cast<T const*>(this)->observedFunctionsImpl(); }
 
         // Return which callbacks are needed for this analysis
         CallBacks requiredCallbacks() const { return static_cast<T const*>(this)->requiredCallbacksImpl(); }
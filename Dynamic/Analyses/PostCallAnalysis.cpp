@@ -2,11 +2,13 @@
 #include "BaseAnalysis.h"
 #include "DynamicAnalysis.h"
 #include "../DynamicUtils.h"
+#include "../StackDepot.h"
 
-#include <vector>
+#include <algorithm>
 
 void PostCallAnalysis::SharedInit(void const* _func_supplier, const char* _target_str, CallParam_t *_params, int64_t num_params) {
     func_supplier = _func_supplier;
+    initCallsiteSlots(func_supplier);
     target_str = _target_str;
     for (int i = 0; i < num_params; i++) {
         params.push_back(&_params[i]);
@@ -22,6 +24,12 @@ PostCallAnalysis::PostCallAnalysis(void const* _func_supplier, CallTagOp_t* call
     target_funcs = DynamicUtils::getFunctionsForTag(callop->target_tag);
 }
 
+arena::vector<void const*> PostCallAnalysis::observedFunctionsImpl() const {
+    arena::vector<void const*> funcs = target_funcs;
+    funcs.push_back(func_supplier);
+    return funcs;
+}
+
 Fulfillment PostCallAnalysis::functionCBImpl(void* const& func, CallsiteInfo const& callsite) {
     for (void const* const& target_func : target_funcs) {
         if (target_func == func) {
@@ -29,41 +37,45 @@ Fulfillment PostCallAnalysis::functionCBImpl(void* const& func, CallsiteInfo con
 
             // Check params if needed
             if (params.empty()) {
-                uncheckedCallsites.clear();
+                clearCallsites(uncheckedCallsites);
                 return Fulfillment::UNKNOWN; // Cannot return fulfilled until program exit, there may be more callsites to come
             }
 
             // Check which callsites are satisfied, remove from unchecked
-            for (auto callsite_iter = uncheckedCallsites.begin(); callsite_iter != uncheckedCallsites.end();) {
-                if (DynamicUtils::checkFuncCallMatch(target_func, params, callsite, *callsite_iter, target_str)) {
-                    callsite_iter = uncheckedCallsites.erase(callsite_iter);
+            size_t first_erased = uncheckedCallsites.size();
+            for (size_t i = 0; i < uncheckedCallsites.size();) {
+                if (DynamicUtils::checkFuncCallMatch(target_func, params, callsite, uncheckedCallsites[i], target_str)) {
+                    callsite_slots[uncheckedCallsites[i].call] = -1;
+                    uncheckedCallsites.erase(uncheckedCallsites.begin() + i);
+                    first_erased = std::min(first_erased, i);
                 } else {
-                    callsite_iter++;
+                    i++;
                 }
             }
+            reindexCallsites(uncheckedCallsites, first_erased);
             // For the rest: Maybe actual fulfillment comes later
             return Fulfillment::UNKNOWN;
         }
     }
 
-    if (func == func_supplier) {
-        for (CallsiteInfo& uncheckedCallsite : uncheckedCallsites) {
-            if (uncheckedCallsite.location == callsite.location) {
-                uncheckedCallsite = callsite;
-                goto exit_postcall_funccb;
-            }
+    if (func == func_supplier && !isProven(callsite)) {
+        // A callsite only needs to be checked for its latest call
+        int32_t& slot = callsiteSlot(callsite.call);
+        if (slot >= 0) {
+            uncheckedCallsites[slot] = callsite;
+        } else {
+            slot = uncheckedCallsites.size();
+            uncheckedCallsites.push_back(callsite);
         }
-        uncheckedCallsites.push_back(callsite);
     }
 
-    exit_postcall_funccb:
     // Irrelevant function
     return Fulfillment::UNKNOWN;
 }
 
 Fulfillment PostCallAnalysis::exitCBImpl(CodePtr const& location) {
     for (CallsiteInfo const& callsite : uncheckedCallsites) {
-        references.push_back(callsite.location);
+        references.push_back(StackDepot::of(callsite));
     }
     return uncheckedCallsites.empty() ? Fulfillment::FULFILLED : Fulfillment::VIOLATED;
 }
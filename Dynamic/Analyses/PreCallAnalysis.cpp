@@ -2,8 +2,8 @@
 #include "BaseAnalysis.h"
 #include "DynamicAnalysis.h"
 #include "../DynamicUtils.h"
+#include "../StackDepot.h"
 
-#include <vector>
 
 void PreCallAnalysis::SharedInit(void const* _func_supplier, const char* _target_str, CallParam_t *_params, int64_t num_params) {
     func_supplier = _func_supplier;
@@ -22,6 +22,12 @@ PreCallAnalysis::PreCallAnalysis(void const* _func_supplier, CallTagOp_t* callop
     target_funcs = DynamicUtils::getFunctionsForTag(callop->target_tag);
 }
 
+arena::vector<void const*> PreCallAnalysis::observedFunctionsImpl() const {
+    arena::vector<void const*> funcs = target_funcs;
+    funcs.push_back(func_supplier);
+    return funcs;
+}
+
 Fulfillment PreCallAnalysis::functionCBImpl(void* const& func, CallsiteInfo const& callsite) {
     for (void const* const& target_func : target_funcs) {
         if (target_func == func) {
@@ -31,11 +37,11 @@ Fulfillment PreCallAnalysis::functionCBImpl(void* const& func, CallsiteInfo cons
         }
     }
 
-    if (func == func_supplier) {
+    if (func == func_supplier && !isProven(callsite)) {
         // Contract supplier found, need to resolve now
         if (possible_matches.empty()) {
             // No matches, verification failed
-            references.push_back(callsite.location);
+            references.push_back(StackDepot::of(callsite));
             return Fulfillment::VIOLATED;
         }
 
@@ -51,7 +57,7 @@ Fulfillment PreCallAnalysis::functionCBImpl(void* const& func, CallsiteInfo cons
         }
 
         // Nothing matched
-        references.push_back(callsite.location);
+        references.push_back(StackDepot::of(callsite));
         return Fulfillment::VIOLATED;
     }
 
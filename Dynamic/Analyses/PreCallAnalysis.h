@@ -4,8 +4,6 @@
 #include "DynamicAnalysis.h"
 #include <unordered_map>
 #include <unordered_set>
-#include <string>
-#include <vector>
 
 struct PreCallAnalysis : BaseAnalysis<PreCallAnalysis> {
     public:
@@ -13,20 +11,22 @@ struct PreCallAnalysis : BaseAnalysis<PreCallAnalysis> {
         PreCallAnalysis(void const* func_supplier, CallTagOp_t* callop);
 
         inline __attribute__((always_inline)) Fulfillment functionCBImpl(void* const& func, CallsiteInfo const& callsite);
-        inline __attribute__((always_inline)) Fulfillment memoryCBImpl(CodePtr const& location, void const* const& memory, bool const& isWrite) const { return Fulfillment::UNKNOWN; }
+        inline __attribute__((always_inline)) Fulfillment memoryCBImpl(CodePtr const& location, SiteId const& site, void const* const& memory, bool const& isWrite) const { return Fulfillment::UNKNOWN; }
+        inline __attribute__((always_inline)) Fulfillment memoryRangeCBImpl(CodePtr const& location, SiteId const& site, void const* const& base, int64_t const& count, int64_t const& stride, bool const& isWrite) const { return Fulfillment::UNKNOWN; }
         inline __attribute__((always_inline)) Fulfillment exitCBImpl(CodePtr const& location) const { return Fulfillment::INACTIVE; };
 
         constexpr CallBacks requiredCallbacksImpl() const { return {true, false, false}; }
+        arena::vector<void const*> observedFunctionsImpl() const;
 
     private:
         void SharedInit(void const* _func_supplier, const char* target_str, CallParam_t *params, int64_t num_params);
 
         // Configuration
         void const* func_supplier;
-        std::string target_str; // Either tag str or func str
-        std::vector<CallParam_t*> params; // Required parameters
-        std::vector<void const*> target_funcs;
+        arena::string target_str; // Either tag str or func str
+        arena::vector<CallParam_t*> params; // Required parameters
+        arena::vector<void const*> target_funcs;
 
         // Analysis temporaries
-        std::unordered_map<void const*, std::vector<CallsiteInfo>> possible_matches;
+        arena::unordered_map<void const*, arena::vector<CallsiteInfo>> possible_matches;
 };
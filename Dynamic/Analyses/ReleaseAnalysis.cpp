@@ -2,17 +2,38 @@
 #include "BaseAnalysis.h"
 #include "DynamicAnalysis.h"
 #include "../DynamicUtils.h"
+#include "../PageWatch.h"
+#include "../Profile.h"
+#include "../StackDepot.h"
+#include "../WatchSet.h"
 
+#include <algorithm>
 #include <cstdint>
-#include <vector>
 
 namespace {
-    void processFunctionForInit(std::string& target, const char* target_orig, std::vector<CallParam_t *>& param_new, int num_params, CallParam_t* params) {
+    void processFunctionForInit(arena::string& target, const char* target_orig, arena::vector<CallParam_t *>& param_new, int num_params, CallParam_t* params) {
         for (int i = 0; i < num_params; i++) {
             param_new.push_back(&params[i]);
         }
         target = target_orig;
     }
+
+    // Bounds are only reset once no buffer of the kind is watched, as watched buffers are not ordered
+    void widenMemBounds(bool isWrite, uintptr_t lo, uintptr_t hi) {
+        uintptr_t* bounds = isWrite ? PPDCV_MemWBounds : PPDCV_MemRBounds;
+        bounds[0] = std::min(bounds[0], lo);
+        bounds[1] = std::max(bounds[1], hi);
+    }
+
+    void releaseMemGate(bool isWrite, int32_t count) {
+        int32_t& gate = isWrite ? PPDCV_MemWGate : PPDCV_MemRGate;
+        gate -= count;
+        if (gate == 0) {
+            uintptr_t* bounds = isWrite ? PPDCV_MemWBounds : PPDCV_MemRBounds;
+            bounds[0] = UINTPTR_MAX;
+            bounds[1] = 0;
+        }
+    }
 }
 
 ReleaseAnalysis::ReleaseAnalysis(void const* _func_supplier, ReleaseOp_t* rOP) {
@@ -21,6 +42,8 @@ ReleaseAnalysis::ReleaseAnalysis(void const* _func_supplier, ReleaseOp_t* rOP) {
         RWOp_t* rwOp = (RWOp_t*)rOP->forbidden_op;
         rwIdx = rwOp->idx;
         rwAcc = rwOp->accType;
+        forbIsWrite = rwOp->isWrite;
+        pageWatch = rwAcc == ParamAccess::DEREF && PageWatch::enabled();
     } else {
         if (rOP->forbidden_op_kind == UNARY_CALLTAG) {
             CallTagOp_t* cOP = (CallTagOp_t*)rOP->forbidden_op;
@@ -45,12 +68,56 @@ ReleaseAnalysis::ReleaseAnalysis(void const* _func_supplier, ReleaseOp_t* rOP) {
     }
 
     func_supplier = _func_supplier;
+    initCallsiteSlots(func_supplier);
+}
+
+arena::vector<void const*> ReleaseAnalysis::observedFunctionsImpl() const {
+    arena::vector<void const*> funcs = rel_funcs;
+    funcs.insert(funcs.end(), forb_funcs.begin(), forb_funcs.end());
+    funcs.push_back(func_supplier);
+    return funcs;
+}
+
+void ReleaseAnalysis::watchBounds(uintptr_t buf, uintptr_t length) {
+    // Only dereferencing accesses are located at the buffer, see memoryCBImpl. Training runs record all accesses, see Profile.h
+    if (rwAcc != ParamAccess::DEREF || Profile::enabled()) widenMemBounds(forbIsWrite, 0, UINTPTR_MAX);
+    else widenMemBounds(forbIsWrite, buf, buf + length - 1);
+}
+
+void ReleaseAnalysis::watchBuffer(uintptr_t buf) {
+    forbMem.push_back(buf, BUFFER_EXTENT);
+    if (pageWatch) PageWatch::watch((void const*)buf, BUFFER_EXTENT, forbIsWrite);
+    else {
+        (forbIsWrite ? PPDCV_MemWGate : PPDCV_MemRGate)++;
+        watchBounds(buf, BUFFER_EXTENT);
+    }
+}
+
+void ReleaseAnalysis::replaceBuffer(size_t idx, uintptr_t buf) {
+    if (pageWatch) {
+        PageWatch::unwatch((void const*)forbMem.start(idx), forbMem.length(idx), forbIsWrite);
+        PageWatch::watch((void const*)buf, BUFFER_EXTENT, forbIsWrite);
+    } else watchBounds(buf, BUFFER_EXTENT);
+    forbMem.set(idx, buf, BUFFER_EXTENT);
+}
+
+void ReleaseAnalysis::unwatchBuffer(size_t idx) {
+    if (pageWatch) PageWatch::unwatch((void const*)forbMem.start(idx), forbMem.length(idx), forbIsWrite);
+    else releaseMemGate(forbIsWrite, 1);
+    forbMem.erase(idx);
+}
+
+void ReleaseAnalysis::unwatchAll() {
+    if (pageWatch)
+        for (size_t i = 0; i < forbMem.size(); i++) PageWatch::unwatch((void const*)forbMem.start(i), forbMem.length(i), forbIsWrite);
+    else releaseMemGate(forbIsWrite, forbMem.size());
+    forbMem.clear();
 }
 
 CallBacks ReleaseAnalysis::requiredCallbacksImpl() const {
     if (!forbIsRW) return {true, false, false};
     RWOp_t* rwOp = (RWOp_t*)forbiddenOp;
-    return {true, !rwOp->isWrite, rwOp->isWrite};
+    return {true, !rwOp->isWrite, rwOp->isWrite, pageWatch};
 }
 
 Fulfillment ReleaseAnalysis::functionCBImpl(void* const& func, CallsiteInfo const& callsite) {
@@ -59,20 +126,24 @@ Fulfillment ReleaseAnalysis::functionCBImpl(void* const& func, CallsiteInfo cons
         for (void const* const& rel_func : rel_funcs) {
             if (rel_func == func) {
                 if (params_release.empty()) {
-                    forbiddenCallsites.clear();
-                    forbMem.clear();
+                    clearCallsites(forbiddenCallsites);
+                    unwatchAll();
                     return Fulfillment::UNKNOWN;
                 }
                 // Check which callsites are satisfied, remove from unchecked
-                for (int i = 0; i < forbiddenCallsites.size();) {
+                size_t first_erased = forbiddenCallsites.size();
+                for (size_t i = 0; i < forbiddenCallsites.size();) {
                     CallsiteInfo const& forbcallsite = forbiddenCallsites[i];
                     if (DynamicUtils::checkFuncCallMatch(rel_func, params_release, callsite, forbcallsite, target_str_rel)) {
+                        callsite_slots[forbcallsite.call] = -1;
                         forbiddenCallsites.erase(forbiddenCallsites.begin() + i);
-                        if (forbIsRW) forbMem.erase(forbMem.begin() + i);
+                        if (forbIsRW) unwatchBuffer(i);
+                        first_erased = std::min(first_erased, i);
                     } else {
                         i++;
                     }
                 }
+                reindexCallsites(forbiddenCallsites, first_erased);
                 // For the rest: Maybe actual fulfillment comes later
                 return Fulfillment::UNKNOWN;
             }
@@ -82,15 +153,15 @@ Fulfillment ReleaseAnalysis::functionCBImpl(void* const& func, CallsiteInfo cons
         for (void const* const& forb_func : forb_funcs) {
             if (forb_func == func) {
                 if (params_forb.empty()) {
-                    for (CallsiteInfo const& forbCallsite : forbiddenCallsites) references.push_back(forbCallsite.location);
-                    references.push_back(callsite.location);
+                    for (CallsiteInfo const& forbCallsite : forbiddenCallsites) references.push_back(StackDepot::of(forbCallsite));
+                    references.push_back(StackDepot::of(callsite));
                     return Fulfillment::VIOLATED;
                 }
 
                 // Check if a callsite is violated
                 for (CallsiteInfo const& forbCallsite : forbiddenCallsites) {
                     if (DynamicUtils::checkFuncCallMatch(forb_func, params_forb, callsite, forbCallsite, target_str_forb)) {
-                        references.insert(references.end(), {forbCallsite.location, callsite.location});
+                        references.insert(references.end(), {StackDepot::of(forbCallsite), StackDepot::of(callsite)});
                         return Fulfillment::VIOLATED;
                     }
                 }
@@ -100,30 +171,54 @@ Fulfillment ReleaseAnalysis::functionCBImpl(void* const& func, CallsiteInfo cons
 
     // Finally, check if supplier.
     // Needs to be done after check for forbidden, so that new supplier is not accidentally checked against itself
-    if (func == func_supplier) {
-        for (int i = 0; i < forbiddenCallsites.size(); i++) {
-            if (forbiddenCallsites[i].location == callsite.location) {
-                forbiddenCallsites[i] = callsite;
-                if (forbIsRW) forbMem[i] = forbiddenCallsites[i].params[rwIdx];
-                goto exit_rel_funccb;
-            }
+    if (func == func_supplier && !isProven(callsite)) {
+        int32_t& slot = callsiteSlot(callsite.call);
+        if (slot >= 0) {
+            forbiddenCallsites[slot] = callsite;
+            if (forbIsRW) replaceBuffer(slot, (uintptr_t)callsite.params[rwIdx].value);
+        } else {
+            slot = forbiddenCallsites.size();
+            forbiddenCallsites.push_back(callsite);
+            if (forbIsRW) watchBuffer((uintptr_t)callsite.params[rwIdx].value);
         }
-        forbiddenCallsites.push_back(callsite);
-        if (forbIsRW) forbMem.push_back(callsite.params[rwIdx]);
     }
 
     // Irrelevant function
-    exit_rel_funccb:
     return Fulfillment::UNKNOWN;
 }
 
-Fulfillment ReleaseAnalysis::memoryCBImpl(CodePtr const& location, void const* const& memory, bool const& isWrite) {
-    for (int i = 0; i < forbMem.size(); i++) {
-        if (DynamicUtils::checkParamMatch(rwAcc, {&forbMem[i].value, sizeof(void*)*8}, {memory, sizeof(void*)*8})) {
-            references.insert(references.end(), {forbiddenCallsites[i].location, location});
+Fulfillment ReleaseAnalysis::memoryCBImpl(CodePtr const& location, SiteId const& site, void const* const& memory, bool const& isWrite) {
+    if (rwAcc == ParamAccess::DEREF) {
+        // Common case: Access to a watched buffer
+        int32_t i = forbMem.find((uintptr_t)memory);
+        if (i == WatchSet::NOT_FOUND) [[likely]] return Fulfillment::UNKNOWN;
+        references.insert(references.end(), {StackDepot::of(forbiddenCallsites[i]), StackDepot::capture(location, site)});
+        unwatchAll(); // Resolved, no need to keep pages protected
+        return Fulfillment::VIOLATED;
+    }
+
+    for (size_t i = 0; i < forbMem.size(); i++) {
+        if (DynamicUtils::checkParamMatch(rwAcc, {&forbMem.start(i), sizeof(void*)*8}, {memory, sizeof(void*)*8})) {
+            references.insert(references.end(), {StackDepot::of(forbiddenCallsites[i]), StackDepot::capture(location, site)});
             return Fulfillment::VIOLATED;
         }
     }
 
     return Fulfillment::UNKNOWN;
 }
+
+Fulfillment ReleaseAnalysis::memoryRangeCBImpl(CodePtr const& location, SiteId const& site, void const* const& base, int64_t const& count, int64_t const& stride, bool const& isWrite) {
+    if (rwAcc == ParamAccess::DEREF) {
+        int32_t i = forbMem.findStrided((uintptr_t)base, count, stride);
+        if (i == WatchSet::NOT_FOUND) [[likely]] return Fulfillment::UNKNOWN;
+        references.insert(references.end(), {StackDepot::of(forbiddenCallsites[i]), StackDepot::capture(location, site)});
+        unwatchAll();
+        return Fulfillment::VIOLATED;
+    }
+
+    for (int64_t i = 0; i < count; i++) {
+        Fulfillment f = memoryCBImpl(location, site, (char const*)base + i * stride, isWrite);
+        if (f != Fulfillment::UNKNOWN) return f;
+    }
+    return Fulfillment::UNKNOWN;
+}
@@ -2,33 +2,45 @@
 
 #include "BaseAnalysis.h"
 #include "DynamicAnalysis.h"
-#include <string>
-#include <vector>
+#include "../WatchSet.h"
 
 struct ReleaseAnalysis : BaseAnalysis<ReleaseAnalysis> {
     public:
         ReleaseAnalysis(void const* func_supplier, ReleaseOp_t* rOP);
         inline __attribute__((always_inline)) Fulfillment functionCBImpl(void* const& func, CallsiteInfo const& callsite);
-        inline __attribute__((always_inline)) Fulfillment memoryCBImpl(CodePtr const& location, void const* const& memory, bool const& isWrite);
+        inline __attribute__((always_inline)) Fulfillment memoryCBImpl(CodePtr const& location, SiteId const& site, void const* const& memory, bool const& isWrite);
+        inline __attribute__((always_inline)) Fulfillment memoryRangeCBImpl(CodePtr const& location, SiteId const& site, void const* const& base, int64_t const& count, int64_t const& stride, bool const& isWrite);
         inline __attribute__((always_inline)) Fulfillment exitCBImpl(CodePtr const& location) const { return Fulfillment::FULFILLED; };
 
         CallBacks requiredCallbacksImpl() const;
+        arena::vector<void const*> observedFunctionsImpl() const;
 
     private:
+        // DEREF contracts forbid accesses that start at the buffer address, see memoryCBImpl
+        static constexpr uintptr_t BUFFER_EXTENT = 1;
+
+        void watchBuffer(uintptr_t buf);
+        void watchBounds(uintptr_t buf, uintptr_t length);
+        void replaceBuffer(size_t idx, uintptr_t buf);
+        void unwatchBuffer(size_t idx);
+        void unwatchAll();
+
         // Configuration
         void const* func_supplier;
         bool forbIsRW = false;
         ParamAccess rwAcc;
         int32_t rwIdx;
+        bool forbIsWrite = false;
+        bool pageWatch = false; // Accesses are reported by PageWatch instead of instrumentation
         void const* forbiddenOp;
-        std::string target_str_forb; // Either tag str or func str
-        std::vector<void const*> forb_funcs;
-        std::vector<CallParam_t*> params_forb;
-        std::string target_str_rel; // Either tag str or func str
-        std::vector<void const*> rel_funcs;
-        std::vector<CallParam_t*> params_release; // Required parameters
+        arena::string target_str_forb; // Either tag str or func str
+        arena::vector<void const*> forb_funcs;
+        arena::vector<CallParam_t*> params_forb;
+        arena::string target_str_rel; // Either tag str or func str
+        arena::vector<void const*> rel_funcs;
+        arena::vector<CallParam_t*> params_release; // Required parameters
 
         // Analysis temporaries
-        std::vector<CallsiteInfo> forbiddenCallsites;
-        std::vector<ConcreteParam> forbMem;
+        arena::vector<CallsiteInfo> forbiddenCallsites;
+        WatchSet forbMem; // Parallel to forbiddenCallsites
 };
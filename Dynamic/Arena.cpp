@@ -0,0 +1,201 @@
+#include "Arena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <sched.h>
+#include <sys/mman.h>
+
+namespace {
+    constexpr size_t MIN_CLASS_SHIFT = 4; // 16 bytes, keeps allocations 16-byte aligned
+    constexpr size_t MAX_CLASS_SHIFT = 12; // Larger allocations are mapped directly
+    constexpr size_t NUM_CLASSES = MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1;
+    constexpr size_t BLOCK_SIZE = 1 << 20;
+    constexpr size_t ARENA_PAGE_SIZE = 4096;
+    static_assert(Arena::MAX_POOLED_SIZE == 1 << MAX_CLASS_SHIFT);
+
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    struct alignas(16) BlockHeader {
+        BlockHeader* next;
+    };
+
+    struct alignas(16) LargeHeader {
+        LargeHeader* prev;
+        LargeHeader* next;
+        size_t mapped_size;
+    };
+
+    // Plain data only: Must stay usable for containers destroyed during static destruction
+    struct ArenaState {
+        FreeNode* free_lists[NUM_CLASSES];
+        BlockHeader* blocks;
+        char* bump;
+        char* bump_end;
+        LargeHeader* large;
+        size_t current;
+        size_t peak;
+        size_t mapped;
+        size_t peak_mapped;
+        bool released;
+    } arena_state;
+
+    // Guards arena_state and all pools. Allocations are short and rarely contended, so a spin lock suffices
+    std::atomic_flag arena_lock;
+
+    struct ArenaLock {
+        ArenaLock() { while (arena_lock.test_and_set(std::memory_order_acquire)) sched_yield(); }
+        ~ArenaLock() { arena_lock.clear(std::memory_order_release); }
+    };
+
+    void* mapMemory(size_t size) {
+        void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            // Cannot use the usual output here, it may allocate
+            std::fputs("CoVer-Dynamic: Out of memory for runtime arena!\n", stderr);
+            std::abort();
+        }
+        arena_state.mapped += size;
+        arena_state.peak_mapped = std::max(arena_state.peak_mapped, arena_state.mapped);
+        return mem;
+    }
+
+    size_t sizeClass(size_t size) {
+        if (size <= (1 << MIN_CLASS_SHIFT)) return 0;
+        return std::bit_width(size - 1) - MIN_CLASS_SHIFT;
+    }
+
+    void* allocateLarge(size_t size) {
+        size_t mapped_size = (size + sizeof(LargeHeader) + ARENA_PAGE_SIZE - 1) & ~(ARENA_PAGE_SIZE - 1);
+        LargeHeader* header = (LargeHeader*)mapMemory(mapped_size);
+        *header = {nullptr, arena_state.large, mapped_size};
+        if (arena_state.large) arena_state.large->prev = header;
+        arena_state.large = header;
+        return header + 1;
+    }
+
+    void deallocateLarge(void* ptr) {
+        LargeHeader* header = (LargeHeader*)ptr - 1;
+        if (header->prev) header->prev->next = header->next;
+        else arena_state.large = header->next;
+        if (header->next) header->next->prev = header->prev;
+        arena_state.mapped -= header->mapped_size;
+        munmap(header, header->mapped_size);
+    }
+
+    void* bumpAllocate(size_t size) {
+        if (arena_state.bump + size > arena_state.bump_end) {
+            // Rest of the current block is abandoned
+            BlockHeader* block = (BlockHeader*)mapMemory(BLOCK_SIZE);
+            block->next = arena_state.blocks;
+            arena_state.blocks = block;
+            arena_state.bump = (char*)(block + 1);
+            arena_state.bump_end = (char*)block + BLOCK_SIZE;
+        }
+        void* result = arena_state.bump;
+        arena_state.bump += size;
+        return result;
+    }
+
+    void* allocateSmall(size_t cls) {
+        if (FreeNode* node = arena_state.free_lists[cls]) {
+            arena_state.free_lists[cls] = node->next;
+            return node;
+        }
+        return bumpAllocate(1 << (cls + MIN_CLASS_SHIFT));
+    }
+
+    // Runs after atexit handlers and static destructors, i.e. after the last use of the runtime
+    __attribute__((destructor)) void releaseArena() {
+        ArenaLock lock;
+        for (BlockHeader* block = arena_state.blocks; block;) {
+            BlockHeader* next = block->next;
+            munmap(block, BLOCK_SIZE);
+            block = next;
+        }
+        for (LargeHeader* header = arena_state.large; header;) {
+            LargeHeader* next = header->next;
+            munmap(header, header->mapped_size);
+            header = next;
+        }
+        size_t peak = arena_state.peak, peak_mapped = arena_state.peak_mapped;
+        arena_state = {};
+        arena_state.peak = peak;
+        arena_state.peak_mapped = peak_mapped;
+        arena_state.released = true;
+    }
+}
+
+namespace Arena {
+    void* allocate(size_t size) {
+        ArenaLock lock;
+        if (size == 0) size = 1;
+        size_t cls = sizeClass(size);
+        void* result;
+        if (cls >= NUM_CLASSES) {
+            result = allocateLarge(size);
+            arena_state.current += size;
+        } else {
+            result = allocateSmall(cls);
+            arena_state.current += 1 << (cls + MIN_CLASS_SHIFT);
+        }
+        arena_state.peak = std::max(arena_state.peak, arena_state.current);
+        return result;
+    }
+
+    void deallocate(void* ptr, size_t size) {
+        ArenaLock lock;
+        if (!ptr || arena_state.released) return;
+        if (size == 0) size = 1;
+        size_t cls = sizeClass(size);
+        if (cls >= NUM_CLASSES) {
+            deallocateLarge(ptr);
+            arena_state.current -= size;
+            return;
+        }
+        FreeNode* node = (FreeNode*)ptr;
+        node->next = arena_state.free_lists[cls];
+        arena_state.free_lists[cls] = node;
+        arena_state.current -= 1 << (cls + MIN_CLASS_SHIFT);
+    }
+
+    void* allocate(Pool& pool) {
+        ArenaLock lock;
+        void* result;
+        // Free lists of pools are not reset when the arena is released, their slots are gone then
+        if (pool.free_list && !arena_state.released) {
+            result = pool.free_list;
+            pool.free_list = ((FreeNode*)result)->next;
+        } else result = bumpAllocate(pool.slot_size);
+        arena_state.current += pool.slot_size;
+        arena_state.peak = std::max(arena_state.peak, arena_state.current);
+        return result;
+    }
+
+    void deallocate(Pool& pool, void* ptr) {
+        ArenaLock lock;
+        if (!ptr || arena_state.released) return;
+        FreeNode* node = (FreeNode*)ptr;
+        node->next = (FreeNode*)pool.free_list;
+        pool.free_list = node;
+        arena_state.current -= pool.slot_size;
+    }
+
+    size_t currentUsage() {
+        return arena_state.current;
+    }
+
+    size_t peakUsage() {
+        return arena_state.peak;
+    }
+
+    size_t peakMapped() {
+        return arena_state.peak_mapped;
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/*
+ * mmap-backed allocator for the runtime's data structures, isolated from the application heap.
+ * Small allocations are served from free lists of power-of-two size classes, large ones are mapped directly.
+ * Single objects are served from a pool per type instead, which holds slots of exactly the size of the type.
+ * All memory is unmapped at once when the program has shut down. All functions may be called from any thread.
+ */
+namespace Arena {
+    void* allocate(size_t size);
+    void deallocate(void* ptr, size_t size);
+
+    // Free list of equally sized slots. Plain data, so that each pool is constant-initialized
+    struct Pool {
+        size_t slot_size;
+        void* free_list;
+    };
+    constexpr size_t MAX_POOLED_SIZE = 4096;
+    void* allocate(Pool& pool);
+    void deallocate(Pool& pool, void* ptr);
+
+    template<typename T>
+    constinit inline Pool type_pool = {(sizeof(T) + 15) & ~size_t(15), nullptr};
+
+    template<typename T>
+    void* allocateFor(size_t n) {
+        if (n == 1 && sizeof(T) <= MAX_POOLED_SIZE) return allocate(type_pool<T>);
+        return allocate(n * sizeof(T));
+    }
+
+    template<typename T>
+    void deallocateFor(void* ptr, size_t n) {
+        if (n == 1 && sizeof(T) <= MAX_POOLED_SIZE) deallocate(type_pool<T>, ptr);
+        else deallocate(ptr, n * sizeof(T));
+    }
+
+    template<typename T, typename... Arguments>
+    T* create(Arguments&&... args) {
+        return new (allocateFor<T>(1)) T(std::forward<Arguments>(args)...);
+    }
+
+    template<typename T>
+    void destroy(T* obj) {
+        obj->~T();
+        deallocateFor<T>(obj, 1);
+    }
+
+    // Bytes currently allocated, and the highest values seen for allocated and mapped bytes
+    size_t currentUsage();
+    size_t peakUsage();
+    size_t peakMapped();
+}
+
+template<typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    ArenaAllocator() = default;
+    template<typename U> ArenaAllocator(ArenaAllocator<U> const&) {}
+
+    // Container nodes are allocated one at a time and end up in the pool of their type
+    T* allocate(size_t n) { return (T*)Arena::allocateFor<T>(n); }
+    void deallocate(T* ptr, size_t n) { Arena::deallocateFor<T>(ptr, n); }
+
+    template<typename U> bool operator==(ArenaAllocator<U> const&) const { return true; }
+};
+
+// Containers allocating from the arena
+namespace arena {
+    template<typename T>
+    using vector = std::vector<T, ArenaAllocator<T>>;
+
+    using string = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+    struct string_hash {
+        size_t operator()(string const& str) const { return std::hash<std::string_view>()(str); }
+    };
+
+    template<typename K, typename V, typename Hash = std::hash<K>>
+    using unordered_map = std::unordered_map<K, V, Hash, std::equal_to<K>, ArenaAllocator<std::pair<K const, V>>>;
+
+    template<typename K, typename Hash = std::hash<K>>
+    using unordered_set = std::unordered_set<K, Hash, std::equal_to<K>, ArenaAllocator<K>>;
+}
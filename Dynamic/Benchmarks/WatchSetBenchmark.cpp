@@ -0,0 +1,60 @@
+/*
+ * Microbenchmark for the watched-buffer lookup on the memory callback path.
+ * Compares the previous per-entry parameter match loop with the WatchSet kernels
+ * for 1 to 64 watched buffers. All queries miss, as nearly all accesses do at runtime.
+ */
+#include "../DynamicUtils.h"
+#include "../WatchSet.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+    constexpr size_t NUM_QUERIES = 1 << 22;
+
+    template<typename F>
+    double timeNs(F&& lookup, std::vector<uintptr_t> const& queries) {
+        int64_t sink = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for (uintptr_t q : queries) sink += lookup(q);
+        auto end = std::chrono::steady_clock::now();
+        asm volatile("" :: "r"(sink));
+        return std::chrono::duration<double, std::nano>(end - begin).count() / queries.size();
+    }
+}
+
+int main() {
+    std::mt19937_64 rng(42);
+    std::vector<uintptr_t> queries(NUM_QUERIES);
+    for (uintptr_t& q : queries) q = (rng() & 0x7fffffffff00) | 1; // Odd addresses never match
+
+    std::printf("%8s %12s %12s %12s %12s\n", "buffers", "paramMatch", "scalar", "avx2", "selected");
+    for (size_t n : {1, 2, 4, 8, 16, 32, 64}) {
+        std::vector<ConcreteParam> params;
+        WatchSet set;
+        std::vector<uintptr_t> starts, lengths;
+        for (size_t i = 0; i < n; i++) {
+            uintptr_t addr = rng() & 0x7ffffffffff0;
+            params.push_back({(void const*)addr, sizeof(void*)*8});
+            set.push_back(addr);
+            starts.push_back(addr);
+            lengths.push_back(1);
+        }
+
+        double legacy = timeNs([&](uintptr_t q) {
+            for (size_t i = 0; i < params.size(); i++)
+                if (DynamicUtils::checkParamMatch(ParamAccess::DEREF, {&params[i].value, sizeof(void*)*8}, {(void const*)q, sizeof(void*)*8}))
+                    return (int32_t)i;
+            return WatchSet::NOT_FOUND;
+        }, queries);
+        auto kernel = [&](WatchSetKernels::FindKernel k) {
+            return timeNs([&](uintptr_t q) { return k(starts.data(), lengths.data(), n, q); }, queries);
+        };
+        double selected = timeNs([&](uintptr_t q) { return set.find(q); }, queries);
+        std::printf("%8zu %10.2fns %10.2fns %10.2fns %10.2fns\n", n, legacy,
+                    kernel(WatchSetKernels::findScalar), kernel(WatchSetKernels::findAVX2), selected);
+    }
+}
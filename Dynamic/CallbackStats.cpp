@@ -0,0 +1,30 @@
+#include "CallbackStats.h"
+#include "DynamicUtils.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+    bool stats_enabled = false;
+    uint64_t callback_counts[CallbackStats::NUM_KINDS] = {};
+}
+
+namespace CallbackStats {
+    bool Initialize() {
+        const char* stats = std::getenv("COVER_CALLBACK_STATS");
+        stats_enabled = stats && std::strcmp(stats, "0") != 0;
+        return stats_enabled;
+    }
+
+    bool enabled() { return stats_enabled; }
+
+    void record(Kind kind) {
+        callback_counts[kind]++;
+    }
+
+    void print() {
+        DynamicUtils::out() << "Memory callbacks reaching the runtime: " << callback_counts[READ] << " reads, " << callback_counts[WRITE] << " writes, "
+                            << callback_counts[RANGE_READ] << " range reads, " << callback_counts[RANGE_WRITE] << " range writes\n";
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Counts of the memory callbacks reaching the runtime (COVER_CALLBACK_STATS=1), printed on exit.
+ * Callbacks skipped inline by gates, fast paths or sampling never reach the runtime and are not counted,
+ * so comparing counts shows how many callbacks an instrumentation option saves.
+ */
+namespace CallbackStats {
+    enum Kind { READ, WRITE, RANGE_READ, RANGE_WRITE, NUM_KINDS };
+
+    // Read configuration. Returns whether callbacks are counted
+    bool Initialize();
+
+    bool enabled();
+
+    void record(Kind kind);
+
+    // Print the counts of this process
+    void print();
+}
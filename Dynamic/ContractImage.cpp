@@ -0,0 +1,181 @@
+#include "ContractImage.h"
+#include "Arena.h"
+#include "DynamicUtils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <dlfcn.h>
+#include <string>
+#include <vector>
+
+namespace {
+    struct ImageDecoder {
+        ContractDBImage_t const* image;
+        DBHeader_t const* header;
+
+        template<typename T>
+        T const* record(uint32_t offset) const {
+            return reinterpret_cast<T const*>(image->blob + offset);
+        }
+
+        const char* string(uint32_t offset) const {
+            return reinterpret_cast<const char*>(image->blob + header->strings + offset);
+        }
+
+        void* function(uint32_t index) const {
+            return index == COVER_DB_NONE ? nullptr : image->functions[index];
+        }
+
+        // Call targets not referenced by this module may be called by others, and are looked up by name
+        void* target(uint32_t index, const char* name) const {
+            return index == COVER_DB_NONE ? dlsym(RTLD_DEFAULT, name) : image->functions[index];
+        }
+
+        template<typename T>
+        T* allocate(uint32_t count) const {
+            return count ? static_cast<T*>(Arena::allocate(count * sizeof(T))) : nullptr;
+        }
+
+        CallParam_t* params(uint32_t offset, uint32_t count) const {
+            CallParam_t* res = allocate<CallParam_t>(count);
+            for (uint32_t i = 0; i < count; i++) {
+                DBCallParam_t const* param = record<DBCallParam_t>(offset) + i;
+                res[i] = {param->callP, param->callPisTagVar != 0, param->contrP, (ParamAccess)param->accType};
+            }
+            return res;
+        }
+
+        void** operation(uint32_t offset, int32_t kind) const {
+            switch ((ContractConnective)kind) {
+                case UNARY_READ:
+                case UNARY_WRITE: {
+                    DBRWOp_t const* op = record<DBRWOp_t>(offset);
+                    return (void**)Arena::create<RWOp_t>(RWOp_t{op->idx, (ParamAccess)op->accType, op->isWrite != 0});
+                }
+                case UNARY_CALL: {
+                    DBCallOp_t const* op = record<DBCallOp_t>(offset);
+                    return (void**)Arena::create<CallOp_t>(CallOp_t{string(op->function_name), params(op->params, op->num_params), (int32_t)op->num_params, target(op->target_function, string(op->function_name))});
+                }
+                case UNARY_CALLTAG: {
+                    DBCallTagOp_t const* op = record<DBCallTagOp_t>(offset);
+                    return (void**)Arena::create<CallTagOp_t>(CallTagOp_t{string(op->target_tag), params(op->params, op->num_params), (int32_t)op->num_params});
+                }
+                case UNARY_RELEASE: {
+                    DBReleaseOp_t const* op = record<DBReleaseOp_t>(offset);
+                    return (void**)Arena::create<ReleaseOp_t>(ReleaseOp_t{operation(op->release_op, op->release_op_kind), op->release_op_kind, operation(op->forbidden_op, op->forbidden_op_kind), op->forbidden_op_kind});
+                }
+                default:
+                    return nullptr;
+            }
+        }
+
+        void formulas(ContractFormula_t* res, uint32_t offset, uint32_t count) const {
+            for (uint32_t i = 0; i < count; i++) {
+                DBFormula_t const* form = record<DBFormula_t>(offset) + i;
+                res[i] = {allocate<ContractFormula_t>(form->num_children), (int32_t)form->num_children, (ContractConnective)form->conn, string(form->msg), nullptr, form->verdict_bit};
+                if (form->num_children) formulas(res[i].children, form->children, form->num_children);
+                else res[i].data = operation(form->data, form->conn);
+            }
+        }
+
+        ContractFormula_t* scope(uint32_t offset) const {
+            if (offset == COVER_DB_NONE) return nullptr;
+            ContractFormula_t* res = allocate<ContractFormula_t>(1);
+            formulas(res, offset, 1);
+            return res;
+        }
+    };
+}
+
+namespace {
+    // Site tables are only resolved when printing, by the load address of their module
+    struct DecodedImage {
+        void const* base;
+        ContractDBImage_t const* image;
+    };
+    arena::vector<DecodedImage> decoded_images;
+
+    ContractDBImage_t const* imageContaining(void const* location) {
+        if (decoded_images.size() == 1) return decoded_images[0].image;
+        Dl_info info;
+        if (!location || !dladdr(location, &info)) return nullptr;
+        for (DecodedImage const& decoded : decoded_images)
+            if (decoded.base == info.dli_fbase) return decoded.image;
+        return nullptr;
+    }
+}
+
+namespace ContractImage {
+    ContractDB_t const* decode(ContractDBImage_t const* image) {
+        ImageDecoder decoder = {image, reinterpret_cast<DBHeader_t const*>(image->blob)};
+        DBHeader_t const* header = decoder.header;
+        if (image->size < sizeof(DBHeader_t) || header->magic != COVER_DB_MAGIC || header->version != COVER_DB_VERSION)
+            return nullptr;
+
+        ContractDB_t* DB = Arena::create<ContractDB_t>();
+        DB->num_contracts = header->num_contracts;
+        DB->contracts = decoder.allocate<Contract_t>(header->num_contracts);
+        // Formulas are decoded once the contract is analysed, see decodeConditions
+        for (uint32_t i = 0; i < header->num_contracts; i++) {
+            DBContract_t const* contr = decoder.record<DBContract_t>(header->contracts) + i;
+            DB->contracts[i] = {nullptr, nullptr, decoder.function(contr->function), decoder.string(contr->function_name)};
+        }
+
+        DB->tagMap.count = header->num_tags;
+        DB->tagMap.functions = decoder.allocate<void*>(header->num_tags);
+        DB->tagMap.tags = decoder.allocate<Tag_t>(header->num_tags);
+        for (uint32_t i = 0; i < header->num_tags; i++) {
+            DBTag_t const* tag = decoder.record<DBTag_t>(header->tags) + i;
+            DB->tagMap.functions[i] = decoder.function(tag->function);
+            DB->tagMap.tags[i] = {decoder.string(tag->tag), tag->param};
+        }
+
+        DB->num_references = header->num_references;
+        DB->references = decoder.allocate<Reference_t>(header->num_references);
+        for (uint32_t i = 0; i < header->num_references; i++) {
+            DBReference_t const* ref = decoder.record<DBReference_t>(header->references) + i;
+            DB->references[i] = {decoder.string(ref->ref), decoder.string(ref->type), &image->counters[ref->counter]};
+        }
+
+        DB->image = image;
+        DB->num_callees = image->num_functions;
+        DB->callees = decoder.allocate<Callee_t>(image->num_functions);
+        for (uint32_t i = 0; i < image->num_functions; i++)
+            DB->callees[i] = {image->functions[i], &image->gates[i], image->num_calls[i]};
+
+        Dl_info info;
+        decoded_images.push_back({dladdr(image, &info) ? info.dli_fbase : nullptr, image});
+        return DB;
+    }
+
+    void decodeConditions(ContractDB_t const* DB, int32_t index) {
+        ImageDecoder decoder = {DB->image, reinterpret_cast<DBHeader_t const*>(DB->image->blob)};
+        DBContract_t const* contr = decoder.record<DBContract_t>(decoder.header->contracts) + index;
+        DB->contracts[index].precondition = decoder.scope(contr->precondition);
+        DB->contracts[index].postcondition = decoder.scope(contr->postcondition);
+    }
+
+    std::string siteLocation(void const* location, uint32_t site, bool withColumn) {
+        if (site == COVER_DB_NONE) return "";
+        ContractDBImage_t const* decoded_image = imageContaining(location);
+        if (!decoded_image || site >= decoded_image->num_sites) return "";
+        DBSite_t const* record = reinterpret_cast<DBSite_t const*>(decoded_image->sites) + site;
+        if (record->file == COVER_DB_NONE) return "";
+        std::string result = reinterpret_cast<const char*>(decoded_image->sites + record->file) + (":" + std::to_string(record->line));
+        if (withColumn) result += ":" + std::to_string(record->column);
+        return result;
+    }
+
+    std::vector<std::string> siteFiles() {
+        std::vector<std::string> files;
+        for (DecodedImage const& decoded : decoded_images) {
+            DBSite_t const* records = reinterpret_cast<DBSite_t const*>(decoded.image->sites);
+            for (uint32_t i = 0; i < decoded.image->num_sites; i++) {
+                if (records[i].file == COVER_DB_NONE) continue;
+                std::string file = reinterpret_cast<const char*>(decoded.image->sites + records[i].file);
+                if (std::find(files.begin(), files.end(), file) == files.end()) files.push_back(file);
+            }
+        }
+        return files;
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "DynamicAnalysis.h"
+#include <string>
+#include <vector>
+
+/*
+ * Decoding of the contract database images emitted by the instrumentation pass, see ContractDBImage.h.
+ * Each instrumented module registers its own image. Records are converted to the structures of DynamicAnalysis.h,
+ * contract formulas only once the runtime analyses them, and strings are used in place.
+ */
+namespace ContractImage {
+    // Returns nullptr if the image was created by an incompatible version of the pass.
+    // Contract conditions are left empty, so that contracts which are never analysed are not decoded
+    ContractDB_t const* decode(ContractDBImage_t const* image);
+
+    // Decode the pre- and postcondition of a contract of a decoded image
+    void decodeConditions(ContractDB_t const* DB, int32_t index);
+
+    // Source location of an instrumented site as file:line[:column]. Empty if unknown
+    // Site ids are local to their module, which is the one containing the code at location
+    std::string siteLocation(void const* location, uint32_t site, bool withColumn);
+
+    // Source files containing instrumented sites, in all decoded images
+    std::vector<std::string> siteFiles();
+}
@@ -2,7 +2,9 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <dlfcn.h>
+#include <fnmatch.h>
 #include <ios>
 #include <iostream>
 #include <optional>
@@ -11,9 +13,11 @@
 #include <string>
 #include <sys/types.h>
 #include <unordered_map>
+#include <algorithm>
 #include <array>
 #include <utility>
 
+#include "ContractImage.h"
 #include "DynamicAnalysis.h"
 
 namespace {
@@ -44,18 +48,27 @@ namespace {
 }
 
 namespace DynamicUtils {
-    std::unordered_map<void const*, std::vector<Tag_t*>> func_to_tags;
-    std::unordered_map<std::string, std::vector<void const*>> tags_to_func;
+    arena::unordered_map<void const*, arena::vector<Tag_t*>> func_to_tags;
+    arena::unordered_map<arena::string, arena::vector<void const*>, arena::string_hash> tags_to_func;
+    arena::unordered_map<void const*, uint32_t> func_to_callee;
+    arena::vector<uint32_t> callee_num_calls;
 
-    void Initialize(ContractDB_t const* DB) {
-        // Initialize Tags
+    void addModule(ContractDB_t const* DB) {
+        // Add Tags. Modules sharing contract definitions tag the same functions
         for (int i = 0; i < DB->tagMap.count; i++) {
             void* function = DB->tagMap.functions[i];
             Tag_t* tag = &DB->tagMap.tags[i];
-            if (!func_to_tags.contains(function)) func_to_tags[function] = {tag};
-            else func_to_tags[function].emplace_back(tag);
-            if (!tags_to_func.contains(tag->tag)) tags_to_func[tag->tag] = {function};
-            else tags_to_func[tag->tag].emplace_back(function);
+            arena::vector<Tag_t*>& func_tags = func_to_tags[function];
+            if (std::any_of(func_tags.begin(), func_tags.end(), [&](Tag_t const* other) { return other->param == tag->param && !strcmp(other->tag, tag->tag); }))
+                continue;
+            func_tags.emplace_back(tag);
+            tags_to_func[tag->tag].emplace_back(function);
+        }
+
+        // Add Callees
+        for (int i = 0; i < DB->num_callees; i++) {
+            if (func_to_callee.emplace(DB->callees[i].function, callee_num_calls.size()).second)
+                callee_num_calls.push_back(0);
         }
     }
 
@@ -71,16 +84,35 @@ namespace DynamicUtils {
         __builtin_unreachable();
     }
 
-    std::vector<void const*> getFunctionsForTag(std::string tag) {
-        if (tags_to_func.contains(tag))
-            return tags_to_func[tag];
-        return {};
+    arena::vector<void const*> getFunctionsForTag(const char* tag) {
+        auto it = tags_to_func.find(tag);
+        return it != tags_to_func.end() ? it->second : arena::vector<void const*>();
+    }
+
+    arena::vector<Tag_t*> const& getTagsForFunction(void const* func) {
+        static arena::vector<Tag_t*> const no_tags;
+        auto it = func_to_tags.find(func);
+        return it != func_to_tags.end() ? it->second : no_tags;
+    }
+
+    uint32_t getCalleeId(void const* func) {
+        auto it = func_to_callee.find(func);
+        return it != func_to_callee.end() ? it->second : COVER_DB_NONE;
+    }
+
+    uint32_t getNumCallees() {
+        return callee_num_calls.size();
+    }
+
+    uint32_t reserveCalls(uint32_t callee, uint32_t count) {
+        uint32_t first = callee_num_calls[callee];
+        callee_num_calls[callee] += count;
+        return first;
     }
 
-    std::vector<Tag_t*> getTagsForFunction(void const* func) {
-        if (func_to_tags.contains(func))
-            return func_to_tags[func];
-        return {};
+    uint32_t getNumCalls(void const* func) {
+        uint32_t callee = getCalleeId(func);
+        return callee != COVER_DB_NONE ? callee_num_calls[callee] : 0;
     }
 
     void createMessage(std::string msg) {
@@ -91,10 +123,10 @@ namespace DynamicUtils {
         return std::cerr << "CoVer-Dynamic: ";
     }
 
-    bool checkFuncCallMatch(void const* callF, std::vector<CallParam_t*> params_expect, CallsiteInfo callParams, CallsiteInfo contrParams, std::string target_str) {
+    bool checkFuncCallMatch(void const* callF, arena::vector<CallParam_t*> const& params_expect, CallsiteInfo const& callParams, CallsiteInfo const& contrParams, arena::string const& target_str) {
         for (CallParam_t* param : params_expect) {
             if (param->callPisTagVar) {
-                std::vector<Tag_t*> tags = DynamicUtils::getTagsForFunction(callF);
+                arena::vector<Tag_t*> const& tags = DynamicUtils::getTagsForFunction(callF);
                 for (Tag_t* tag : tags) {
                     if (tag->tag != target_str) continue;
                     if (DynamicUtils::checkParamMatch(param->accType, contrParams.params[param->contrP], callParams.params[tag->param]))
@@ -108,7 +140,9 @@ namespace DynamicUtils {
         return false;
     }
 
-    std::string getFileRefStr(void const* location) {
+    std::string getFileRefStr(void const* location, SiteId site) {
+        std::string site_loc = ContractImage::siteLocation(location, site, true);
+        if (!site_loc.empty()) return site_loc;
         std::optional<std::pair<std::string, const void *>> dlinfo = getDLInfo(location);
         if (!dlinfo) {
             return "dladdr failure!";
@@ -142,4 +176,24 @@ namespace DynamicUtils {
         }
         return std::optional<std::pair<std::string, void const*>>({std::string(info.dli_fname), location});
     }
+
+    std::vector<std::string> getEnvList(const char* name) {
+        std::vector<std::string> result;
+        const char* env = std::getenv(name);
+        if (!env) return result;
+        std::stringstream list(env);
+        std::string entry;
+        while (std::getline(list, entry, ';')) {
+            if (!entry.empty()) result.push_back(entry);
+        }
+        return result;
+    }
+
+    bool matchesAnyPattern(std::vector<std::string> const& patterns, const char* str) {
+        if (!str) return false;
+        for (std::string const& pattern : patterns) {
+            if (fnmatch(pattern.c_str(), str, 0) == 0) return true;
+        }
+        return false;
+    }
 }
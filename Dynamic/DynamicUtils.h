@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Arena.h"
 #include "DynamicAnalysis.h"
 #include <cstdint>
 #include <functional>
@@ -11,6 +12,8 @@
 #include <vector>
 
 using CodePtr = void const*;
+using SiteId = uint32_t; // Index into the site table of the image, COVER_DB_NONE if not an instrumented site
+using StackId = uint32_t; // See StackDepot
 struct ConcreteParam {
     void const* value;
     uint32_t size;
@@ -18,7 +21,11 @@ struct ConcreteParam {
 };
 struct CallsiteInfo {
     CodePtr location;
-    std::vector<ConcreteParam> params;
+    SiteId site = COVER_DB_NONE;
+    uint32_t call = 0; // Ordinal of the callsite among those of the same callee
+    arena::vector<ConcreteParam> params;
+    StackId stack = 0;
+    uint64_t proven = 0; // Verdict bits of the expressions statically proven for this callsite
     bool operator==(CallsiteInfo const& other) const {
         return this->location == other.location && params == other.params;
     }
@@ -36,20 +43,32 @@ struct std::hash<CallsiteInfo> {
 };
 
 namespace DynamicUtils {
-    // Initialize Utils
-    void Initialize(ContractDB_t const* DB);
+    // Add tags and callees of a module. Callees are merged by function, so that each has one callee id across modules
+    void addModule(ContractDB_t const* DB);
 
     // Check if two parameters match
     bool checkParamMatch(ParamAccess const& acc, ConcreteParam const& contrP, ConcreteParam const& callP);
 
     // Check if function call matches
-    bool checkFuncCallMatch(void const* callF, std::vector<CallParam_t*> params_expect, CallsiteInfo callParams, CallsiteInfo contrParams, std::string target_str);
+    bool checkFuncCallMatch(void const* callF, arena::vector<CallParam_t*> const& params_expect, CallsiteInfo const& callParams, CallsiteInfo const& contrParams, arena::string const& target_str);
 
     // Resolve tag to possible functions
-    std::vector<void const*> getFunctionsForTag(std::string tag);
+    arena::vector<void const*> getFunctionsForTag(const char* tag);
 
     // Resolve function to possible tags
-    std::vector<Tag_t*> getTagsForFunction(void const* func);
+    arena::vector<Tag_t*> const& getTagsForFunction(void const* func);
+
+    // Resolve function to its callee id, COVER_DB_NONE if it is not an instrumented callee
+    uint32_t getCalleeId(void const* func);
+
+    // Number of callee ids, i.e. of distinct instrumented callees in all modules
+    uint32_t getNumCallees();
+
+    // Reserve count consecutive call ids of a callee, returns the first
+    uint32_t reserveCalls(uint32_t callee, uint32_t count);
+
+    // Number of call ids reserved for a function so far, see reserveCalls
+    uint32_t getNumCalls(void const* func);
 
     // Report something
     void createMessage(std::string msg);
@@ -57,10 +76,16 @@ namespace DynamicUtils {
     // Report something (ostream)
     std::ostream& out();
 
-    // Resolve loc ptr to printable string
-    std::string getFileRefStr(void const* location);
+    // Resolve loc ptr to printable string. Instrumented sites are resolved using the site table, others using addr2line
+    std::string getFileRefStr(void const* location, SiteId site = COVER_DB_NONE);
     std::string getFileRefStr(std::string file, void const* parsed_loc);
 
     // Get information needed for references
     std::optional<std::pair<std::string, void const*>> getDLInfo(void const* location);
+
+    // Split a ';'-separated environment variable into its entries. Empty if unset
+    std::vector<std::string> getEnvList(const char* name);
+
+    // Check if str matches any of the given glob patterns
+    bool matchesAnyPattern(std::vector<std::string> const& patterns, const char* str);
 }
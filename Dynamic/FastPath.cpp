@@ -0,0 +1,46 @@
+#include "DynamicAnalysis.h"
+
+#include <cstdint>
+
+/*
+ * Fast paths of the memory callbacks, compiled to bitcode instead of being part of the runtime library.
+ * InstrumentPass links them into the module after the static analysis, calls them instead of the runtime
+ * and marks them always-inline, so that they are inlined at each instrumented access afterwards.
+ * They are external functions here, as inline functions would not be emitted into the bitcode if unused.
+ * Accesses outside the bounds of all watched buffers return without calling into the runtime.
+ */
+
+namespace {
+    inline __attribute__((always_inline)) bool outsideBounds(uintptr_t const* bounds, uintptr_t lo, uintptr_t hi) {
+        return hi < bounds[0] || lo > bounds[1];
+    }
+
+    inline __attribute__((always_inline)) bool rangeOutsideBounds(uintptr_t const* bounds, void const* base, int64_t count, int64_t stride) {
+        if (count <= 0) return true;
+        uintptr_t first = (uintptr_t)base;
+        uintptr_t last = first + (count - 1) * stride;
+        return stride < 0 ? outsideBounds(bounds, last, first) : outsideBounds(bounds, first, last);
+    }
+}
+
+extern "C" {
+    void PPDCV_MemRFastPath(uint32_t site, void const* buf) {
+        if (outsideBounds(PPDCV_MemRBounds, (uintptr_t)buf, (uintptr_t)buf)) [[likely]] return;
+        PPDCV_MemRCallback(site, buf);
+    }
+
+    void PPDCV_MemWFastPath(uint32_t site, void const* buf) {
+        if (outsideBounds(PPDCV_MemWBounds, (uintptr_t)buf, (uintptr_t)buf)) [[likely]] return;
+        PPDCV_MemWCallback(site, buf);
+    }
+
+    void PPDCV_MemRangeRFastPath(uint32_t site, void const* base, int64_t count, int64_t stride) {
+        if (rangeOutsideBounds(PPDCV_MemRBounds, base, count, stride)) [[likely]] return;
+        PPDCV_MemRangeRCallback(site, base, count, stride);
+    }
+
+    void PPDCV_MemRangeWFastPath(uint32_t site, void const* base, int64_t count, int64_t stride) {
+        if (rangeOutsideBounds(PPDCV_MemWBounds, base, count, stride)) [[likely]] return;
+        PPDCV_MemRangeWCallback(site, base, count, stride);
+    }
+}
@@ -11,24 +11,61 @@
 #include <vector>
 #include <cstdarg>
 
+#include "CallbackStats.h"
+#include "ContractImage.h"
 #include "DynamicAnalysis.h"
 #include "DynamicUtils.h"
+#include "PageWatch.h"
+#include "Profile.h"
+#include "Sampling.h"
+#include "StackDepot.h"
 
 #include "Hooks.hpp"
 
-extern "C" void __attribute__((visibility("default"))) PPDCV_Initialize(int32_t* argc, char*** argv, ContractDB_t const* DB) {
+extern "C" {
+    __attribute__((visibility("default"))) int32_t PPDCV_MemRGate = 0;
+    __attribute__((visibility("default"))) int32_t PPDCV_MemWGate = 0;
+    __attribute__((visibility("default"))) uintptr_t PPDCV_MemRBounds[2] = {UINTPTR_MAX, 0};
+    __attribute__((visibility("default"))) uintptr_t PPDCV_MemWBounds[2] = {UINTPTR_MAX, 0};
+}
+
+extern "C" void __attribute__((visibility("default"))) PPDCV_RegisterModule(ContractDBImage_t const* image) {
+    ContractDB_t const* DB = ContractImage::decode(image);
+    if (!DB) {
+        DynamicUtils::createMessage("Contract database of a module was created by an incompatible version of CoVer! Module not analysed.");
+        return;
+    }
+    // Constructors of the executable and its libraries run before main, dlopened modules register afterwards
+    if (!initialized) {
+        pending_modules.push_back(DB);
+        return;
+    }
+    PageWatch::RuntimeScope scope;
+    size_t const prev_analyses = all_analyses.size();
+    addModule(DB);
+    DynamicUtils::out() << "Registered " << all_analyses.size() - prev_analyses << " analyses of a loaded module\n";
+    reportUnwatchableAnalyses();
+}
+
+extern "C" void __attribute__((visibility("default"))) PPDCV_Initialize(int32_t* argc, char*** argv) {
     DynamicUtils::createMessage("Initializing...");
-    DynamicUtils::Initialize(DB);
+    if (pending_modules.empty()) {
+        DynamicUtils::createMessage("No compatible contract database registered! Analysis disabled.");
+        return;
+    }
+    StackDepot::Initialize();
 
     if (*argc >= 2) {
         std::string arg = (*argv)[1];
         if (arg == "--cover:check-coverage") {
             DynamicUtils::createMessage("Coverage check requested!");
-            // Fill relevant locs
+            // Fill relevant locs of all modules loaded at startup
             std::unordered_set<Reference_t*> relevantLocs;
-            for (int i = 0; i < DB->num_references; i++)
-                relevantLocs.insert(&DB->references[i]);
+            for (ContractDB_t const* DB : pending_modules)
+                for (int i = 0; i < DB->num_references; i++)
+                    relevantLocs.insert(&DB->references[i]);
             std::vector<std::pair<std::string, void*>> coverageVisited;
+            std::vector<std::string> coverageResolved;
             for (std::filesystem::path const& entry : std::filesystem::directory_iterator(coverage_prefix)) {
                 if (entry.filename().string().starts_with("CoVerCoverage")) {
                     DynamicUtils::out() << "Reading coverage file " << entry.filename() << "...\n";
@@ -36,6 +73,12 @@ extern "C" void __attribute__((visibility("default"))) PPDCV_Initialize(int32_t*
                     std::string line = "";
                     while (std::getline(coverage_file, line)) {
                         if (line.empty()) continue;
+                        if (line[0] == '@') {
+                            // Resolved already, followed by the hit count
+                            coverageResolved.push_back(line.substr(1, line.find_last_of('|') - 1));
+                            continue;
+                        }
+                        // Legacy format: Binary and offset, resolved using addr2line
                         int pos = line.find_first_of('|');
                         std::string parsed_loc_s = line.substr(pos + 1);
                         long parsed_loc = std::strtoul(parsed_loc_s.c_str(), nullptr, 16);
@@ -43,10 +86,11 @@ extern "C" void __attribute__((visibility("default"))) PPDCV_Initialize(int32_t*
                     }
                 }
             }
-            if (!coverageVisited.empty()) DynamicUtils::out() << "Coverage read complete, no more coverage files detected. Checking...\n";
+            if (!coverageVisited.empty() || !coverageResolved.empty()) DynamicUtils::out() << "Coverage read complete, no more coverage files detected. Checking...\n";
             else DynamicUtils::out() << "No coverage data found. Either program was not executed, or no relevant locations were encountered.\n";
-            for (std::pair<std::string,void const*> loc : coverageVisited) {
-                std::string locstr = DynamicUtils::getFileRefStr(loc.first, loc.second);
+            for (std::pair<std::string,void const*> loc : coverageVisited)
+                coverageResolved.push_back(DynamicUtils::getFileRefStr(loc.first, loc.second));
+            for (std::string const& locstr : coverageResolved) {
                 std::erase_if(relevantLocs, [&](Reference_t* relRef){ return relRef->ref == locstr; });
             }
             if (!relevantLocs.empty()) {
@@ -62,24 +106,30 @@ extern "C" void __attribute__((visibility("default"))) PPDCV_Initialize(int32_t*
         }
     }
 
-    visitedLocs.reserve(DB->num_references * 3); // Reserve more as some lines contain multiple callbacks
+    // Filters are applied before analysis creation, so unselected contracts have no runtime cost
+    contract_include = DynamicUtils::getEnvList("COVER_CONTRACT_INCLUDE");
+    contract_exclude = DynamicUtils::getEnvList("COVER_CONTRACT_EXCLUDE");
 
-    // Create contract map and analyses for each operation
-    for (int i = 0; i < DB->num_contracts; i++) {
-        void* function = DB->contracts[i].function;
-        if (!contrs.contains(function)) contrs[function] = {};
-        contrs[function].push_back(DB->contracts[i]);
-        if (DB->contracts[i].precondition) {
-            recurseCreateAnalyses(DB->contracts[i].precondition, nullptr, true, function);
-            toplevel_to_contract[DB->contracts[i].precondition] = &DB->contracts[i];
-        }
-        if (DB->contracts[i].postcondition) {
-            recurseCreateAnalyses(DB->contracts[i].postcondition, nullptr, false, function);
-            toplevel_to_contract[DB->contracts[i].postcondition] = &DB->contracts[i];
-        }
-    }
+    // Needs to be known before analysis creation, as release analyses watch their buffers
+    PageWatch::Initialize(onWatchedPageAccess);
+    Sampling::Initialize();
+    Profile::Initialize();
+    CallbackStats::Initialize();
 
-    DynamicUtils::out() << "Registered " << all_analyses.size() << " analyses\n";
+    initialized = true;
+    for (ContractDB_t const* DB : pending_modules) addModule(DB);
+    pending_modules.clear();
+
+    DynamicUtils::out() << "Registered " << all_analyses.size() << " analyses";
+    if (modules.size() > 1) std::cerr << " of " << modules.size() << " modules";
+    std::cerr << "\n";
+    if (duplicate_contracts)
+        DynamicUtils::out() << "Skipped " << duplicate_contracts << " contracts also defined by another module\n";
+    if (!contract_include.empty() || !contract_exclude.empty())
+        DynamicUtils::out() << "Skipped " << skipped_analyses << " analyses due to contract filters\n";
+    reportUnwatchableAnalyses();
+    if (analyses_with_memRCB.empty() && analyses_with_memWCB.empty())
+        DynamicUtils::createMessage("No active analysis requires memory callbacks");
 
     contract_status.reserve(formula_parents.size() + 2);
 
@@ -88,24 +138,68 @@ extern "C" void __attribute__((visibility("default"))) PPDCV_Initialize(int32_t*
     DynamicUtils::createMessage("Finished Initializing!");
 }
 
-extern "C" void __attribute__((visibility("default"))) PPDCV_FunctionCallback(bool isRef, void* function, int32_t num_params, ...) {
-    CallsiteInfo callsite = { .location = __builtin_return_address(0) };
+extern "C" void __attribute__((visibility("default"))) PPDCV_FunctionCallback(SiteId site, ContractDBImage_t const* module, uint32_t callee, uint32_t call, uint64_t proven, int32_t const* param_idx, int32_t num_params, ...) {
+    Module const* mod = getModule(module);
+    if (!mod || callee >= mod->callees.size()) [[unlikely]] return; // Not registered from a compatible image
+    PageWatch::RuntimeScope scope;
+    uint32_t const global_callee = mod->callees[callee];
+    // Verdict bits refer to the contract formulas of the calling module
+    if (proven) {
+        auto contract_module = contract_modules.find(callee_functions[global_callee]);
+        if (contract_module == contract_modules.end() || contract_module->second != module) proven = 0;
+    }
+    CallsiteInfo callsite = { .location = __builtin_return_address(0), .site = site, .call = mod->call_bases[callee] + call, .params = {}, .stack = 0, .proven = proven };
     std::va_list list;
     va_start(list, num_params);
-    for (int i = 0; i < num_params; i++) {
-        uint32_t param_size = va_arg(list,uint32_t);
-        void const* param_val = va_arg(list,void*);
-        callsite.params.push_back({param_val, param_size});
-    }
+    handleFunctionCall(callsite, global_callee, param_idx, num_params, list);
+    va_end(list);
+}
+
+extern "C" void __attribute__((visibility("default"))) PPDCV_FunctionWrapperCallback(void const* location, ContractDBImage_t const* module, uint32_t callee, int32_t const* param_idx, int32_t num_params, ...) {
+    Module const* mod = getModule(module);
+    if (!mod || callee >= mod->callees.size()) [[unlikely]] return;
+    PageWatch::RuntimeScope scope;
+    uint32_t const global_callee = mod->callees[callee];
+    // Wrappers also see callsites in uninstrumented code, which get their call id on first use
+    auto [call, inserted] = wrapper_call_ids.try_emplace(location, 0);
+    if (inserted) call->second = DynamicUtils::reserveCalls(global_callee, 1);
+    CallsiteInfo callsite = { .location = location, .site = COVER_DB_NONE, .call = call->second, .params = {}, .stack = 0, .proven = 0 };
+    std::va_list list;
+    va_start(list, num_params);
+    handleFunctionCall(callsite, global_callee, param_idx, num_params, list);
     va_end(list);
+}
 
-    // Run event handlers and remove analysis if done
-    HANDLE_CALLBACK(analyses_with_funcCB, onFunctionCall, function, callsite);
+extern "C" void __attribute__((visibility("default"))) PPDCV_MemRCallback(SiteId site, void const* buf) {
+    if (CallbackStats::enabled()) [[unlikely]] CallbackStats::record(CallbackStats::READ);
+    if (analyses_with_memRCB.empty()) [[likely]] return;
+    void const* location = __builtin_return_address(0);
+    Sampling::CallbackScope sampling;
+    if (Profile::enabled()) [[unlikely]] Profile::recordAccess(location, site, false);
+    HANDLE_CALLBACK(location, analyses_with_memRCB, onMemoryAccess, site, buf, false);
+}
+extern "C" void __attribute__((visibility("default"))) PPDCV_MemWCallback(SiteId site, void const* buf) {
+    if (CallbackStats::enabled()) [[unlikely]] CallbackStats::record(CallbackStats::WRITE);
+    if (analyses_with_memWCB.empty()) [[likely]] return;
+    void const* location = __builtin_return_address(0);
+    Sampling::CallbackScope sampling;
+    if (Profile::enabled()) [[unlikely]] Profile::recordAccess(location, site, true);
+    HANDLE_CALLBACK(location, analyses_with_memWCB, onMemoryAccess, site, buf, true);
 }
 
-extern "C" void __attribute__((visibility("default"))) PPDCV_MemRCallback(bool isRef, void const* buf) {
-    HANDLE_CALLBACK(analyses_with_memRCB, onMemoryAccess, buf, false);
+extern "C" void __attribute__((visibility("default"))) PPDCV_MemRangeRCallback(SiteId site, void const* base, int64_t count, int64_t stride) {
+    if (CallbackStats::enabled()) [[unlikely]] CallbackStats::record(CallbackStats::RANGE_READ);
+    if (analyses_with_memRCB.empty()) [[likely]] return;
+    void const* location = __builtin_return_address(0);
+    Sampling::CallbackScope sampling;
+    if (Profile::enabled()) [[unlikely]] Profile::recordAccess(location, site, false);
+    HANDLE_CALLBACK(location, analyses_with_memRCB, onMemoryRangeAccess, site, base, count, stride, false);
 }
-extern "C" void __attribute__((visibility("default"))) PPDCV_MemWCallback(bool isRef, void const* buf) {
-    HANDLE_CALLBACK(analyses_with_memWCB, onMemoryAccess, buf, true);
+extern "C" void __attribute__((visibility("default"))) PPDCV_MemRangeWCallback(SiteId site, void const* base, int64_t count, int64_t stride) {
+    if (CallbackStats::enabled()) [[unlikely]] CallbackStats::record(CallbackStats::RANGE_WRITE);
+    if (analyses_with_memWCB.empty()) [[likely]] return;
+    void const* location = __builtin_return_address(0);
+    Sampling::CallbackScope sampling;
+    if (Profile::enabled()) [[unlikely]] Profile::recordAccess(location, site, true);
+    HANDLE_CALLBACK(location, analyses_with_memWCB, onMemoryRangeAccess, site, base, count, stride, true);
 }
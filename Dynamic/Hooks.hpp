@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cstdarg>
 #include <filesystem>
 #include <iostream>
 #include <fstream>
@@ -5,12 +7,18 @@
 #include <string>
 #include <unistd.h>
 #include <unordered_map>
+#include <unordered_set>
 #include <ctime>
 #include <variant>
 #include <vector>
 
 #include "Analyses/BaseAnalysis.h"
+#include "Arena.h"
+#include "CallbackStats.h"
 #include "DynamicUtils.h"
+#include "PageWatch.h"
+#include "Sampling.h"
+#include "StackDepot.h"
 
 #include "Analyses/PreCallAnalysis.h"
 #include "Analyses/PostCallAnalysis.h"
@@ -25,6 +33,9 @@ namespace {
     };
 
     std::unordered_map<void*, std::vector<Contract_t>> contrs;
+    // Module whose contracts were used for each supplier. Modules sharing contract definitions would otherwise create duplicate analyses
+    std::unordered_map<void*, ContractDBImage_t const*> contract_modules;
+    int duplicate_contracts = 0;
 
     using AnalysisVariant = std::variant<PreCallAnalysis*,PostCallAnalysis*,ReleaseAnalysis*>;
 
@@ -33,43 +44,113 @@ namespace {
         AnalysisVariant analysis;
     };
 
-    std::unordered_set<void const*> visitedLocs;
+    // Instrumented modules. Callee and call ids passed by a module's callbacks are local to it
+    struct Module {
+        ContractDB_t const* DB; // Includes the relevant locations for coverage, with hit counters maintained by instrumented code
+        arena::vector<uint32_t> callees; // Callee id across modules, per local callee id
+        arena::vector<uint32_t> call_bases; // First call id across modules, per local callee id
+    };
+    arena::vector<Module*> modules;
+    arena::vector<ContractDB_t const*> pending_modules; // Registered before PPDCV_Initialize
+    bool initialized = false;
+
+    inline Module const* getModule(ContractDBImage_t const* image) {
+        static Module const* last = nullptr;
+        if (last && last->DB->image == image) [[likely]] return last;
+        for (Module const* module : modules) {
+            if (module->DB->image == image) return last = module;
+        }
+        return nullptr;
+    }
     
     std::filesystem::path const& coverage_prefix = std::getenv("COVER_COVERAGE_FOLDER") ? std::filesystem::path(std::getenv("COVER_COVERAGE_FOLDER")) : std::filesystem::current_path();
 
-    std::unordered_map<ContractFormula_t*, Fulfillment> contract_status;
-    std::unordered_map<ContractFormula_t*, ContractFormula_t*> formula_parents;
-    std::unordered_map<ContractFormula_t*, Contract_t*> toplevel_to_contract;
-    std::vector<AnalysisPair> all_analyses;
-    std::vector<AnalysisPair> analyses_with_funcCB;
-    std::vector<AnalysisPair> analyses_with_memRCB;
-    std::vector<AnalysisPair> analyses_with_memWCB;
-    std::unordered_map<ContractFormula_t*, std::vector<void const*>> analysis_references;
+    // Runtime state is kept in the arena, see Arena.h
+    arena::unordered_map<ContractFormula_t*, Fulfillment> contract_status;
+    arena::unordered_map<ContractFormula_t*, ContractFormula_t*> formula_parents;
+    arena::unordered_map<ContractFormula_t*, Contract_t*> toplevel_to_contract;
+    arena::vector<AnalysisPair> all_analyses;
+    arena::vector<AnalysisPair> analyses_with_memRCB;
+    arena::vector<AnalysisPair> analyses_with_memWCB;
+    arena::vector<AnalysisPair> analyses_with_pageRCB;
+    arena::vector<AnalysisPair> analyses_with_pageWCB;
+    arena::unordered_map<ContractFormula_t*, arena::vector<StackId>> analysis_references;
+
+    // Contract selection, see isFormulaSelected
+    std::vector<std::string> contract_include;
+    std::vector<std::string> contract_exclude;
+    int skipped_analyses = 0;
+
+    // Analyses with read!/write! operations that PageWatch cannot watch while it is enabled, see ReleaseAnalysis
+    int unwatchable_analyses = 0;
+
+    // Per callee id: gate words of all modules calling the callee, counting the unresolved analyses observing it, and these analyses
+    arena::vector<arena::vector<int32_t*>> callee_gates;
+    arena::vector<void*> callee_functions;
+    arena::vector<arena::vector<AnalysisPair>> analyses_by_callee;
+
+    void adjustCalleeGates(uint32_t callee, int32_t delta) {
+        for (int32_t* gate : callee_gates[callee]) *gate += delta;
+    }
+
+    template<typename Analysis>
+    arena::vector<uint32_t> observedCallees(Analysis* analysis) {
+        arena::vector<uint32_t> callees;
+        for (void const* func : analysis->observedFunctions()) {
+            uint32_t callee = DynamicUtils::getCalleeId(func);
+            if (callee != COVER_DB_NONE && std::find(callees.begin(), callees.end(), callee) == callees.end())
+                callees.push_back(callee);
+        }
+        return callees;
+    }
+
+    template<typename Analysis>
+    void registerCallees(Analysis* analysis, AnalysisPair const& pair) {
+        for (uint32_t callee : observedCallees(analysis)) {
+            analyses_by_callee[callee].push_back(pair);
+            adjustCalleeGates(callee, 1);
+        }
+    }
+
+    // Resolved analyses stop observing their callees. The list currently handled erases the analysis itself
+    template<typename Analysis>
+    void unregisterCallees(Analysis* analysis, ContractFormula_t* form, arena::vector<AnalysisPair> const* current) {
+        for (uint32_t callee : observedCallees(analysis)) {
+            adjustCalleeGates(callee, -1);
+            arena::vector<AnalysisPair>& pairs = analyses_by_callee[callee];
+            if (&pairs != current)
+                std::erase_if(pairs, [&](AnalysisPair const& pair) { return pair.formula == form; });
+        }
+    }
 
     ErrorMessage recurseCreateErrorMsg(ContractFormula_t* form);
     void formatError(ErrorMessage msg, int indent = 2);
 
     template<typename Analysis, typename... Arguments>
     inline void addAnalysis(ContractFormula_t* form, Arguments... args) {
-        AnalysisPair new_pair = {form, new Analysis(args...)};
+        Analysis* analysis = Arena::create<Analysis>(args...);
+        analysis->setVerdictBit(form->verdict_bit);
+        AnalysisPair new_pair = {form, analysis};
         all_analyses.push_back(new_pair);
 
         CallBacks reqCB = fastVisit([&](auto& analysis) {
             return analysis->requiredCallbacks();
         }, new_pair.analysis);
-        if (reqCB.FUNCTION) analyses_with_funcCB.push_back(new_pair);
-        if (reqCB.MEMORY_R) analyses_with_memRCB.push_back(new_pair);
-        if (reqCB.MEMORY_W) analyses_with_memWCB.push_back(new_pair);
+        if (reqCB.FUNCTION) fastVisit([&](auto& analysis) { registerCallees(analysis, new_pair); }, new_pair.analysis);
+        if (reqCB.MEMORY_R) (reqCB.PAGES ? analyses_with_pageRCB : analyses_with_memRCB).push_back(new_pair);
+        if (reqCB.MEMORY_W) (reqCB.PAGES ? analyses_with_pageWCB : analyses_with_memWCB).push_back(new_pair);
+        if ((reqCB.MEMORY_R || reqCB.MEMORY_W) && !reqCB.PAGES && PageWatch::enabled()) unwatchable_analyses++;
     }
 
-    #define HANDLE_CALLBACK(pairs, CB, ...) \
-        void const* location = __builtin_return_address(0);\
-        if (isRef) visitedLocs.insert(location);\
+    #define HANDLE_CALLBACK(location, pairs, CB, ...) \
         _Pragma("unroll(5)") for (auto it = pairs.begin(); it < pairs.end();) { \
             it = fastVisit([&](auto& analysis) { \
                 Fulfillment f = analysis->CB(std::move(location), __VA_ARGS__);\
                 if (f != Fulfillment::UNKNOWN && f != Fulfillment::INACTIVE) { \
-                    if (!contract_status.contains(it->formula)) contract_status[it->formula] = f; \
+                    if (!contract_status.contains(it->formula)) { \
+                        contract_status[it->formula] = f; \
+                        if (analysis->requiredCallbacks().FUNCTION) unregisterCallees(analysis, it->formula, &pairs); \
+                    } \
                     analysis_references[it->formula] = analysis->getReferences(); \
                     validateState(it->formula); \
                     return pairs.erase(it); \
@@ -91,6 +172,8 @@ namespace {
             DynamicUtils::out() << "Error in contract for function \"" << C->function_name << "\":\n";
             DynamicUtils::out() << (form == C->precondition ? "Precondition:\n" : "Postcondition:\n");
             formatError(recurseCreateErrorMsg(form));
+            if (Sampling::enabled())
+                DynamicUtils::out() << "Note: Memory accesses are checked by sampling, effective rate so far " << 100 * Sampling::effectiveRate() << "%\n";
             return;
         }
 
@@ -152,6 +235,43 @@ namespace {
         }
     }
 
+    bool formulaMatches(std::vector<std::string> const& patterns, ContractFormula_t const* form) {
+        if (DynamicUtils::matchesAnyPattern(patterns, form->msg)) return true;
+        for (int i = 0; i < form->num_children; i++)
+            if (formulaMatches(patterns, &form->children[i])) return true;
+        return false;
+    }
+
+    bool contractMatches(std::vector<std::string> const& patterns, Contract_t const* C, ContractFormula_t const* form) {
+        if (DynamicUtils::matchesAnyPattern(patterns, C->function_name)) return true;
+        for (Tag_t const* tag : DynamicUtils::getTagsForFunction(C->function))
+            if (DynamicUtils::matchesAnyPattern(patterns, tag->tag)) return true;
+        return formulaMatches(patterns, form);
+    }
+
+    // Top-level formulas are selected by supplier name, supplier tags or any message in the formula
+    bool isFormulaSelected(Contract_t const* C, ContractFormula_t const* form) {
+        if (!contract_include.empty() && !contractMatches(contract_include, C, form)) return false;
+        return contract_exclude.empty() || !contractMatches(contract_exclude, C, form);
+    }
+
+    int countOperations(ContractFormula_t const* form) {
+        if (form->num_children == 0) return 1;
+        int num = 0;
+        for (int i = 0; i < form->num_children; i++) num += countOperations(&form->children[i]);
+        return num;
+    }
+
+    void createScopeAnalyses(Contract_t* C, ContractFormula_t* scope, bool isPre) {
+        formula_parents[scope] = nullptr;
+        toplevel_to_contract[scope] = C;
+        for (int i = 0; i < scope->num_children; i++) {
+            ContractFormula_t* form = &scope->children[i];
+            if (isFormulaSelected(C, form)) recurseCreateAnalyses(form, scope, isPre, C->function);
+            else skipped_analyses += countOperations(form);
+        }
+    }
+
     ErrorMessage recurseCreateErrorMsg(ContractFormula_t* form) {
         if (contract_status[form] != Fulfillment::VIOLATED) return {};
         if (form->num_children == 0) {
@@ -171,9 +291,14 @@ namespace {
                 }
                 default: __builtin_unreachable();
             }
-            std::vector<void const*> const& references = analysis_references[form];
-            for (void const* loc : references)
-                msg.msg.push_back(std::string("Reference: ") + DynamicUtils::getFileRefStr(loc));
+            arena::vector<StackId> const& references = analysis_references[form];
+            for (StackId ref : references) {
+                std::vector<CodePtr> stack = StackDepot::get(ref);
+                if (stack.empty()) continue;
+                msg.msg.push_back(std::string("Reference: ") + DynamicUtils::getFileRefStr(stack[0], StackDepot::getSite(ref)));
+                for (size_t i = 1; i < stack.size(); i++)
+                    msg.msg.push_back(std::string("  Called from: ") + DynamicUtils::getFileRefStr(stack[i]));
+            }
             return msg;
         }
         std::vector<ErrorMessage> child_msg;
@@ -211,7 +336,9 @@ namespace {
     }
 
     void printCoverageFile() {
-        if (visitedLocs.empty()) return;
+        if (std::none_of(modules.begin(), modules.end(), [](Module const* module) {
+            return std::any_of(module->DB->references, module->DB->references + module->DB->num_references, [](Reference_t const& ref) { return *ref.counter; });
+        })) return;
         std::srand(std::time({}) + getpid());
         std::stringstream file_suffix;
         file_suffix << std::hex << rand();
@@ -219,14 +346,105 @@ namespace {
         std::string output_path = coverage_prefix / ("CoVerCoverage_" + file_suffix.str());
         DynamicUtils::out() << "Writing coverage file to " << output_path << "\n";
         std::ofstream coverage_file(output_path);
-        for (void const* loc : visitedLocs) {
-            std::optional<std::pair<std::string, const void *>> info = DynamicUtils::getDLInfo(loc);
-            if (!info) continue;
-            coverage_file << info->first << "|" << std::hex << (uintptr_t)info->second << "\n";
+        // Locations are resolved already, so that checking needs no addr2line. Format: @location|hit count
+        std::unordered_set<uint8_t const*> written;
+        for (Module const* module : modules) {
+            for (int i = 0; i < module->DB->num_references; i++) {
+                Reference_t const& ref = module->DB->references[i];
+                if (*ref.counter && written.insert(ref.counter).second)
+                    coverage_file << "@" << ref.ref << "|" << (int)*ref.counter << "\n";
+            }
+        }
+    }
+
+    void reportUnwatchableAnalyses() {
+        if (unwatchable_analyses)
+            DynamicUtils::createMessage(std::to_string(unwatchable_analyses) + " read!/write! contracts do not forbid accessing the buffer itself and cannot use page protection. They are only checked at instrumented memory accesses");
+        unwatchable_analyses = 0;
+    }
+
+    void onWatchedPageAccess(CodePtr location, void const* buf, bool isWrite) {
+        SiteId site = COVER_DB_NONE; // Faulting accesses are resolved using addr2line
+        if (isWrite) {
+            HANDLE_CALLBACK(location, analyses_with_pageWCB, onMemoryAccess, site, buf, true);
+        } else {
+            HANDLE_CALLBACK(location, analyses_with_pageRCB, onMemoryAccess, site, buf, false);
+        }
+    }
+
+    // Callsites only seen by wrappers get their call id on first use, following those reserved for instrumented callsites
+    arena::unordered_map<CodePtr, uint32_t> wrapper_call_ids;
+
+    // Merge the callees of a module with those of earlier modules, and create the analyses of its contracts
+    void addModule(ContractDB_t const* DB) {
+        size_t const prev_callees = callee_gates.size();
+        DynamicUtils::addModule(DB);
+        callee_gates.resize(DynamicUtils::getNumCallees());
+        callee_functions.resize(DynamicUtils::getNumCallees());
+        analyses_by_callee.resize(DynamicUtils::getNumCallees());
+
+        Module* module = Arena::create<Module>(Module{DB, {}, {}});
+        modules.push_back(module);
+        for (int i = 0; i < DB->num_callees; i++) {
+            uint32_t callee = DynamicUtils::getCalleeId(DB->callees[i].function);
+            module->callees.push_back(callee);
+            module->call_bases.push_back(DynamicUtils::reserveCalls(callee, DB->callees[i].num_calls));
+            // Function callbacks are only enabled for callees an analysis is waiting for, see addAnalysis
+            *DB->callees[i].gate = callee_gates[callee].empty() ? 0 : *callee_gates[callee][0];
+            callee_gates[callee].push_back(DB->callees[i].gate);
+            callee_functions[callee] = DB->callees[i].function;
         }
+
+        // Unresolved analyses of earlier modules may observe callees first called by this module
+        if (prev_callees < callee_gates.size()) {
+            for (AnalysisPair const& pair : all_analyses) {
+                if (contract_status.contains(pair.formula)) continue;
+                fastVisit([&](auto& analysis) {
+                    if (!analysis->requiredCallbacks().FUNCTION) return;
+                    for (uint32_t callee : observedCallees(analysis)) {
+                        if (callee < prev_callees) continue;
+                        analyses_by_callee[callee].push_back(pair);
+                        adjustCalleeGates(callee, 1);
+                    }
+                }, pair.analysis);
+            }
+        }
+
+        // Create contract map and analyses for each operation
+        for (int i = 0; i < DB->num_contracts; i++) {
+            void* function = DB->contracts[i].function;
+            if (contract_modules.try_emplace(function, DB->image).first->second != DB->image) {
+                duplicate_contracts++;
+                continue;
+            }
+            ContractImage::decodeConditions(DB, i);
+            contrs[function].push_back(DB->contracts[i]);
+            if (DB->contracts[i].precondition) createScopeAnalyses(&DB->contracts[i], DB->contracts[i].precondition, true);
+            if (DB->contracts[i].postcondition) createScopeAnalyses(&DB->contracts[i], DB->contracts[i].postcondition, false);
+        }
+    }
+
+    void handleFunctionCall(CallsiteInfo& callsite, uint32_t callee, int32_t const* param_idx, int32_t num_params, std::va_list list) {
+        // Accesses to watched pages happened before this call, and may be forbidden until it
+        PageWatch::processFaults();
+        void* function = callee_functions[callee];
+        // Parameters not referenced by any contract are not passed, and stay empty
+        if (num_params > 0) callsite.params.resize(param_idx[num_params - 1] + 1, {nullptr, 0});
+        for (int i = 0; i < num_params; i++) {
+            uint32_t param_size = va_arg(list,uint32_t);
+            void const* param_val = va_arg(list,void*);
+            callsite.params[param_idx[i]] = {param_val, param_size};
+        }
+        if (StackDepot::capturesCallers()) callsite.stack = StackDepot::capture(callsite.location, callsite.site);
+
+        // Run event handlers and remove analysis if done
+        HANDLE_CALLBACK(callsite.location, analyses_by_callee[callee], onFunctionCall, function, callsite);
     }
 
     void PPDCV_destructor() {
+        PageWatch::RuntimeScope scope;
+        PageWatch::processFaults();
+        PageWatch::Finalize();
         for (AnalysisPair const& pair : all_analyses) {
             fastVisit([&](auto&& analysis) {
                 if (!contract_status.contains(pair.formula)) {
@@ -234,11 +452,16 @@ namespace {
                     validateState(pair.formula);
                     analysis_references[pair.formula] = analysis->getReferences();
                 }
-                delete analysis;
+                Arena::destroy(analysis);
             }, pair.analysis);
         }
+        if (Sampling::enabled())
+            DynamicUtils::out() << "Memory accesses were checked by sampling, effective rate " << 100 * Sampling::effectiveRate() << "%. Violations may have been missed.\n";
+        if (CallbackStats::enabled()) CallbackStats::print();
         DynamicUtils::out() << "Analysis finished. Writing coverage file... ";
         printCoverageFile();
         std::cerr << "Done.\n";
+        Profile::write();
+        DynamicUtils::out() << "Runtime memory peak: " << Arena::peakUsage() / 1024 << " KiB allocated, " << Arena::peakMapped() / 1024 << " KiB mapped\n";
     }
 }
@@ -0,0 +1,280 @@
+#include "PageWatch.h"
+#include "DynamicUtils.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <link.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#define COVER_PAGEWATCH_SUPPORTED 1
+#endif
+
+#ifdef COVER_PAGEWATCH_SUPPORTED
+namespace {
+    constexpr size_t PAGE_TABLE_SIZE = 1 << 14; // Power of two
+    constexpr int MAX_PENDING = 16;
+    constexpr int MAX_FAULTS = 256;
+    constexpr size_t ALT_STACK_SIZE = 1 << 16;
+    constexpr greg_t TRAP_FLAG = 0x100;
+
+    struct PageSlot {
+        uintptr_t page; // 0 if never used
+        uint32_t reads;
+        uint32_t writes;
+    };
+
+    // Access to a watched page, recorded by the fault handler and reported to the analyses later
+    struct Fault {
+        uintptr_t pc;
+        uintptr_t addr;
+        bool isWrite;
+    };
+
+    // All state touched by the signal handlers lives in its own mapping, so it is never on a watched page.
+    // Signal handlers cannot take locks, so the state is unguarded and only one thread may touch watched pages, see PageWatch.h
+    struct PageWatchState {
+        PageWatch::FaultHandler handler;
+        uintptr_t page_size;
+        uintptr_t module_begin;
+        uintptr_t module_end;
+        int runtime_depth;
+        int num_pending;
+        uintptr_t pending[MAX_PENDING];
+        int num_faults;
+        int dropped_faults;
+        Fault faults[MAX_FAULTS];
+        struct sigaction old_segv;
+        struct sigaction old_trap;
+        PageSlot table[PAGE_TABLE_SIZE];
+    };
+
+    // Handlers need to read the state pointer, so it gets a page of its own that is never watched
+    struct alignas(4096) {
+        PageWatchState* ptr = nullptr;
+    } watch_state_page;
+    PageWatchState*& watch_state = watch_state_page.ptr;
+    bool table_full_warned = false;
+    bool faults_dropped_warned = false;
+
+    PageSlot* findSlot(uintptr_t page) {
+        size_t idx = (page / watch_state->page_size) & (PAGE_TABLE_SIZE - 1);
+        for (size_t i = 0; i < PAGE_TABLE_SIZE; i++) {
+            PageSlot* slot = &watch_state->table[(idx + i) & (PAGE_TABLE_SIZE - 1)];
+            if (slot->page == page) return slot;
+            if (slot->page == 0) return nullptr;
+        }
+        return nullptr;
+    }
+
+    PageSlot* getSlot(uintptr_t page) {
+        if (PageSlot* slot = findSlot(page)) return slot;
+        // Reuse the first unused slot in the probe sequence
+        size_t idx = (page / watch_state->page_size) & (PAGE_TABLE_SIZE - 1);
+        for (size_t i = 0; i < PAGE_TABLE_SIZE; i++) {
+            PageSlot* slot = &watch_state->table[(idx + i) & (PAGE_TABLE_SIZE - 1)];
+            if (slot->page == 0 || (!slot->reads && !slot->writes)) {
+                slot->page = page;
+                return slot;
+            }
+        }
+        return nullptr;
+    }
+
+    int protectionFor(PageSlot const* slot) {
+        if (slot && slot->reads) return PROT_NONE;
+        if (slot && slot->writes) return PROT_READ;
+        return PROT_READ | PROT_WRITE;
+    }
+
+    // Restore the protection of all pages unprotected for single-stepping
+    void flushPending() {
+        while (watch_state->num_pending > 0) {
+            uintptr_t page = watch_state->pending[--watch_state->num_pending];
+            mprotect((void*)page, watch_state->page_size, protectionFor(findSlot(page)));
+        }
+    }
+
+    // Signals not caused by PageWatch go to the handler installed before, as if PageWatch was not there
+    void forwardSignal(int sig, struct sigaction const& old, siginfo_t* info, void* ctx) {
+        if (old.sa_flags & SA_SIGINFO) {
+            old.sa_sigaction(sig, info, ctx);
+        } else if (old.sa_handler == SIG_DFL || old.sa_handler == SIG_IGN) {
+            // Default action. A fault happens again once the handler returns, other signals are raised again
+            sigaction(sig, &old, nullptr);
+            if (sig != SIGSEGV) raise(sig);
+        } else {
+            old.sa_handler(sig);
+        }
+    }
+
+    // Only async-signal-safe work: Faults are recorded here and reported by PageWatch::processFaults
+    void onSegv(int sig, siginfo_t* info, void* ctx) {
+        ucontext_t* uc = (ucontext_t*)ctx;
+        uintptr_t addr = (uintptr_t)info->si_addr;
+        uintptr_t page = addr & ~(watch_state->page_size - 1);
+        PageSlot* slot = findSlot(page);
+        if (info->si_code != SEGV_ACCERR || !slot || (!slot->reads && !slot->writes)) {
+            forwardSignal(sig, watch_state->old_segv, info, ctx);
+            return;
+        }
+
+        uintptr_t pc = uc->uc_mcontext.gregs[REG_RIP];
+        bool isWrite = uc->uc_mcontext.gregs[REG_ERR] & 2;
+        if (watch_state->runtime_depth == 0 && pc >= watch_state->module_begin && pc < watch_state->module_end) {
+            if (watch_state->num_faults < MAX_FAULTS) watch_state->faults[watch_state->num_faults++] = {pc, addr, isWrite};
+            else watch_state->dropped_faults++;
+        }
+
+        // Execute the access once with the page unprotected, see onTrap.
+        // On overflow, interrupted accesses whose page is protected again simply fault once more
+        if (watch_state->num_pending == MAX_PENDING) flushPending();
+        watch_state->pending[watch_state->num_pending++] = page;
+        mprotect((void*)page, watch_state->page_size, PROT_READ | PROT_WRITE);
+        uc->uc_mcontext.gregs[REG_EFL] |= TRAP_FLAG;
+    }
+
+    void onTrap(int sig, siginfo_t* info, void* ctx) {
+        if (watch_state->num_pending == 0) {
+            // Not single-stepping
+            forwardSignal(sig, watch_state->old_trap, info, ctx);
+            return;
+        }
+        flushPending();
+        ((ucontext_t*)ctx)->uc_mcontext.gregs[REG_EFL] &= ~TRAP_FLAG;
+    }
+
+    int findMainModule(dl_phdr_info* info, size_t, void*) {
+        // First object is the main executable
+        for (int i = 0; i < info->dlpi_phnum; i++) {
+            ElfW(Phdr) const& phdr = info->dlpi_phdr[i];
+            if (phdr.p_type != PT_LOAD || !(phdr.p_flags & PF_X)) continue;
+            uintptr_t begin = info->dlpi_addr + phdr.p_vaddr;
+            if (!watch_state->module_begin || begin < watch_state->module_begin) watch_state->module_begin = begin;
+            if (begin + phdr.p_memsz > watch_state->module_end) watch_state->module_end = begin + phdr.p_memsz;
+        }
+        return 1;
+    }
+
+    void updatePages(void const* buf, size_t size, bool isWrite, int delta) {
+        uintptr_t first = (uintptr_t)buf & ~(watch_state->page_size - 1);
+        uintptr_t last = ((uintptr_t)buf + (size ? size : 1) - 1) & ~(watch_state->page_size - 1);
+        for (uintptr_t page = first; page <= last; page += watch_state->page_size) {
+            PageSlot* slot = delta > 0 ? getSlot(page) : findSlot(page);
+            if (!slot) {
+                if (delta > 0 && !table_full_warned) {
+                    DynamicUtils::createMessage("Too many watched pages, some buffers are not watched!");
+                    table_full_warned = true;
+                }
+                continue;
+            }
+            int old_prot = protectionFor(slot);
+            (isWrite ? slot->writes : slot->reads) += delta;
+            int new_prot = protectionFor(slot);
+            if (new_prot != old_prot) mprotect((void*)page, watch_state->page_size, new_prot);
+        }
+    }
+}
+
+namespace PageWatch {
+    bool Initialize(FaultHandler handler) {
+        const char* mode = std::getenv("COVER_WATCH_MODE");
+        if (!mode || std::string(mode) != "pages") return false;
+
+        void* mem = mmap(nullptr, sizeof(PageWatchState), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        void* alt_stack = mmap(nullptr, ALT_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED || alt_stack == MAP_FAILED) {
+            DynamicUtils::createMessage("Could not allocate page watch watch_state, falling back to instrumented memory accesses");
+            return false;
+        }
+        watch_state = (PageWatchState*)mem;
+        watch_state->handler = handler;
+        watch_state->page_size = sysconf(_SC_PAGESIZE);
+        dl_iterate_phdr(findMainModule, nullptr);
+
+        // Watched pages may include the stack, so handlers run on their own
+        stack_t ss = {};
+        ss.ss_sp = alt_stack;
+        ss.ss_size = ALT_STACK_SIZE;
+        sigaltstack(&ss, nullptr);
+
+        // SA_NODEFER: Forwarded signals may be raised again within the handler
+        struct sigaction sa = {};
+        sa.sa_sigaction = onSegv;
+        sa.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_NODEFER;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGSEGV, &sa, &watch_state->old_segv);
+        sa.sa_sigaction = onTrap;
+        sigaction(SIGTRAP, &sa, &watch_state->old_trap);
+
+        DynamicUtils::createMessage("Watching memory using page protection");
+        return true;
+    }
+
+    void Finalize() {
+        if (!watch_state) return;
+        for (PageSlot& slot : watch_state->table) {
+            if (slot.reads || slot.writes) mprotect((void*)slot.page, watch_state->page_size, PROT_READ | PROT_WRITE);
+            slot = {};
+        }
+        sigaction(SIGSEGV, &watch_state->old_segv, nullptr);
+        sigaction(SIGTRAP, &watch_state->old_trap, nullptr);
+        watch_state = nullptr;
+    }
+
+    bool enabled() {
+        return watch_state != nullptr;
+    }
+
+    void processFaults() {
+        if (!watch_state || !watch_state->num_faults) return;
+        RuntimeScope scope;
+        // Faults in the runtime are not recorded, so the list does not change while reporting
+        for (int i = 0; i < watch_state->num_faults; i++) {
+            Fault const& fault = watch_state->faults[i];
+            watch_state->handler((CodePtr)fault.pc, (void const*)fault.addr, fault.isWrite);
+        }
+        watch_state->num_faults = 0;
+        if (watch_state->dropped_faults && !faults_dropped_warned) {
+            DynamicUtils::createMessage("Too many accesses to watched pages between function callbacks, some accesses were not checked!");
+            faults_dropped_warned = true;
+        }
+    }
+
+    void watch(void const* buf, size_t size, bool isWrite) {
+        if (watch_state) updatePages(buf, size, isWrite, 1);
+    }
+
+    void unwatch(void const* buf, size_t size, bool isWrite) {
+        if (watch_state) updatePages(buf, size, isWrite, -1);
+    }
+
+    RuntimeScope::RuntimeScope() {
+        if (watch_state) watch_state->runtime_depth++;
+    }
+
+    RuntimeScope::~RuntimeScope() {
+        if (watch_state) watch_state->runtime_depth--;
+    }
+}
+#else
+namespace PageWatch {
+    bool Initialize(FaultHandler) {
+        if (std::getenv("COVER_WATCH_MODE") && std::string(std::getenv("COVER_WATCH_MODE")) == "pages")
+            DynamicUtils::createMessage("Page protection watch mode is not supported on this platform, falling back to instrumented memory accesses");
+        return false;
+    }
+    void Finalize() {}
+    bool enabled() { return false; }
+    void processFaults() {}
+    void watch(void const*, size_t, bool) {}
+    void unwatch(void const*, size_t, bool) {}
+    RuntimeScope::RuntimeScope() {}
+    RuntimeScope::~RuntimeScope() {}
+}
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "DynamicUtils.h"
+#include <cstddef>
+
+/*
+ * Alternative to memory access instrumentation (COVER_WATCH_MODE=pages).
+ * Pages containing watched buffers are protected with mprotect. Faults on these pages are
+ * recorded if they originate from the main executable, then the access is single-stepped with
+ * the page unprotected and the protection is restored. As analyses are not async-signal-safe,
+ * recorded faults are only reported to the fault handler by processFaults, at the next function callback.
+ * Only supported on x86-64 Linux, and assumes a single application thread touches watched pages.
+ */
+namespace PageWatch {
+    // Called for each access to a watched page. location is the faulting instruction.
+    using FaultHandler = void (*)(CodePtr location, void const* memory, bool isWrite);
+
+    // Read configuration and install signal handlers. Returns whether page watching is active.
+    bool Initialize(FaultHandler handler);
+
+    // Unprotect all pages and restore the previous signal handlers
+    void Finalize();
+
+    bool enabled();
+
+    // Report the faults recorded since the last call to the fault handler. Called outside of signal handlers
+    void processFaults();
+
+    // Protect the pages of [buf, buf + size). Write watches still allow reads.
+    void watch(void const* buf, size_t size, bool isWrite);
+    void unwatch(void const* buf, size_t size, bool isWrite);
+
+    // Marks runtime code. Faults caused by the runtime itself are single-stepped without reporting.
+    struct RuntimeScope {
+        RuntimeScope();
+        ~RuntimeScope();
+    };
+}
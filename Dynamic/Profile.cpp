@@ -0,0 +1,70 @@
+#include "Profile.h"
+#include "Arena.h"
+#include "ContractImage.h"
+#include "DynamicAnalysis.h"
+#include "DynamicUtils.h"
+#include "PageWatch.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <set>
+#include <string>
+#include <unistd.h>
+
+namespace {
+    const char* profile_path = nullptr;
+
+    // Sites by return address of their callback, as site ids are local to the module of the callback
+    arena::unordered_map<CodePtr, SiteId> hot_reads;
+    arena::unordered_map<CodePtr, SiteId> hot_writes;
+
+    // Several callbacks may share a source location, e.g. after inlining
+    int appendHotSites(std::string& profile, arena::unordered_map<CodePtr, SiteId> const& hot_sites, const char* kind) {
+        std::set<std::string> locations;
+        for (std::pair<CodePtr const, SiteId> const& hot : hot_sites) {
+            std::string location = ContractImage::siteLocation(hot.first, hot.second, true);
+            if (!location.empty()) locations.insert(location);
+        }
+        for (std::string const& location : locations) profile += std::string(kind) + " " + location + "\n";
+        return locations.size();
+    }
+}
+
+namespace Profile {
+    bool Initialize() {
+        profile_path = std::getenv("COVER_PROFILE_OUT");
+        if (!profile_path) return false;
+        if (PageWatch::enabled()) {
+            DynamicUtils::createMessage("Ignoring COVER_PROFILE_OUT, as memory accesses are observed by page faults");
+            profile_path = nullptr;
+            return false;
+        }
+        DynamicUtils::out() << "Recording memory sites accessed during release windows for profile " << profile_path << "\n";
+        return true;
+    }
+
+    bool enabled() { return profile_path; }
+
+    void recordAccess(CodePtr location, SiteId site, bool isWrite) {
+        // Gates count the watched buffers of each kind, see ReleaseAnalysis::watchBuffer
+        if (site == COVER_DB_NONE || (isWrite ? PPDCV_MemWGate : PPDCV_MemRGate) <= 0) return;
+        (isWrite ? hot_writes : hot_reads).try_emplace(location, site);
+    }
+
+    void write() {
+        if (!profile_path) return;
+        // Format: "file <path>" for each instrumented source file, "read|write <path>:<line>:<column>" for each hot site
+        std::string profile;
+        for (std::string const& file : ContractImage::siteFiles()) profile += "file " + file + "\n";
+        int num_hot = appendHotSites(profile, hot_reads, "read") + appendHotSites(profile, hot_writes, "write");
+        // Single append, so that profiles of concurrent processes, e.g. MPI ranks, are not interleaved
+        int fd = open(profile_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0 || ::write(fd, profile.data(), profile.size()) != (ssize_t)profile.size()) {
+            DynamicUtils::createMessage("Could not write profile to " + std::string(profile_path) + "!");
+        } else {
+            DynamicUtils::out() << "Appended " << num_hot << " memory sites accessed during release windows to profile " << profile_path << "\n";
+        }
+        if (fd >= 0) close(fd);
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "DynamicUtils.h"
+
+/*
+ * Training runs for profile-guided instrumentation (COVER_PROFILE_OUT=<file>).
+ * Records each memory callback site executed while a read!/write! release window of its kind was open,
+ * which includes all accesses to watched buffers. On exit, the source locations of these sites and the
+ * source files instrumented in the run are appended to the profile file, so that several runs accumulate.
+ * Compiling with --instrument-contracts=profile=<file> then drops the memory callbacks of all other sites.
+ * Bounds of the memory callback fast paths are disabled during training, so all accesses in a window are seen.
+ */
+namespace Profile {
+    // Read configuration. Returns whether memory sites are recorded
+    bool Initialize();
+
+    bool enabled();
+
+    // Record a memory callback at an instrumented site
+    void recordAccess(CodePtr location, SiteId site, bool isWrite);
+
+    // Append the profile of this run to the profile file
+    void write();
+}
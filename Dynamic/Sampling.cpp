@@ -0,0 +1,81 @@
+#include "Sampling.h"
+#include "DynamicAnalysis.h"
+#include "DynamicUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+extern "C" {
+    __attribute__((visibility("default"))) int32_t PPDCV_SamplePeriod = 1;
+}
+
+namespace {
+    constexpr int32_t MAX_PERIOD = 1 << 20;
+    constexpr uint64_t WINDOW_CALLS = 1024; // Period is adjusted after this many sampled callbacks
+
+    bool sampling_enabled = false;
+    double overhead_budget = 0; // Percent
+    uint64_t window_start = 0;
+    uint64_t window_ticks = 0; // Spent in callbacks during the window
+    uint64_t window_calls = 0;
+    uint64_t sampled_accesses = 0;
+    uint64_t represented_accesses = 0; // Each sampled callback stands for a period of accesses
+
+    inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    void adjustPeriod(uint64_t now) {
+        uint64_t outside = std::max<uint64_t>(now - window_start - std::min(window_ticks, now - window_start), 1);
+        double overhead = 100.0 * window_ticks / outside;
+        if (overhead > overhead_budget && PPDCV_SamplePeriod < MAX_PERIOD) PPDCV_SamplePeriod *= 2;
+        else if (overhead < overhead_budget / 2 && PPDCV_SamplePeriod > 1) PPDCV_SamplePeriod /= 2;
+        window_start = now;
+        window_ticks = 0;
+        window_calls = 0;
+    }
+}
+
+namespace Sampling {
+    bool Initialize() {
+        const char* budget = std::getenv("COVER_OVERHEAD_BUDGET");
+        if (!budget) return false;
+        overhead_budget = std::atof(budget);
+        if (overhead_budget <= 0) {
+            DynamicUtils::createMessage("Ignoring invalid COVER_OVERHEAD_BUDGET, all sampled sites are checked");
+            return false;
+        }
+        sampling_enabled = true;
+        window_start = ticks();
+        DynamicUtils::out() << "Sampling memory accesses with an overhead budget of " << overhead_budget << "%\n";
+        return true;
+    }
+
+    bool enabled() { return sampling_enabled; }
+
+    double effectiveRate() {
+        return represented_accesses ? (double)sampled_accesses / represented_accesses : 1.0;
+    }
+
+    CallbackScope::CallbackScope() {
+        start = sampling_enabled ? ticks() : 0;
+    }
+
+    CallbackScope::~CallbackScope() {
+        if (!sampling_enabled) return;
+        uint64_t now = ticks();
+        window_ticks += now - start;
+        sampled_accesses++;
+        represented_accesses += PPDCV_SamplePeriod;
+        if (++window_calls == WINDOW_CALLS) adjustPeriod(now);
+    }
+}
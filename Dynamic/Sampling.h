@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Overhead-bounded checking of memory accesses (COVER_OVERHEAD_BUDGET=<percent>).
+ * With -cover-sample-memory, each memory callback site only calls back every PPDCV_SamplePeriod executions.
+ * The time spent in memory callbacks is measured and the period is doubled while it exceeds the budget,
+ * relative to the time spent outside of them, and halved again while below half the budget.
+ * Function callbacks are never sampled, so that analysis state stays consistent.
+ */
+namespace Sampling {
+    // Read configuration. Returns whether the period is adjusted
+    bool Initialize();
+
+    bool enabled();
+
+    // Fraction of memory accesses at sampled sites that were checked so far
+    double effectiveRate();
+
+    // Measures a memory callback
+    struct CallbackScope {
+        CallbackScope();
+        ~CallbackScope();
+        uint64_t start;
+    };
+}
@@ -0,0 +1,86 @@
+#include "StackDepot.h"
+#include "Arena.h"
+#include "DynamicUtils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <execinfo.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    constexpr int MAX_DEPTH = 64;
+    constexpr int MAX_RUNTIME_FRAMES = 8; // Frames between backtrace() and the instrumented code
+
+    struct StackEntry {
+        uint32_t offset;
+        uint32_t size;
+        SiteId site;
+    };
+
+    int max_depth = 1;
+    arena::vector<CodePtr> frames; // Frames of all stacks, concatenated
+    arena::vector<StackEntry> entries = {{0, 0, COVER_DB_NONE}}; // Id 0 is reserved as invalid
+    arena::unordered_map<uint64_t, arena::vector<StackId>> stacks_by_hash;
+
+    uint64_t hashFrames(CodePtr const* stack, int size) {
+        // FNV-1a over the frame addresses
+        uint64_t hash = 14695981039346656037ULL;
+        for (int i = 0; i < size; i++) {
+            hash ^= (uintptr_t)stack[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+}
+
+namespace StackDepot {
+    void Initialize() {
+        if (const char* depth = std::getenv("COVER_STACK_DEPTH")) {
+            max_depth = std::clamp(std::atoi(depth), 1, MAX_DEPTH);
+            if (max_depth > 1) DynamicUtils::out() << "Capturing call stacks of depth " << max_depth << "\n";
+        }
+    }
+
+    StackId capture(CodePtr location, SiteId site) {
+        CodePtr buffer[MAX_DEPTH + MAX_RUNTIME_FRAMES];
+        CodePtr const* stack = &location;
+        int size = 1;
+        if (max_depth > 1) {
+            int num_frames = backtrace((void**)buffer, max_depth + MAX_RUNTIME_FRAMES);
+            for (int i = 0; i < num_frames; i++) {
+                if (buffer[i] != location) continue;
+                stack = &buffer[i];
+                size = std::min(num_frames - i, max_depth);
+                break;
+            }
+        }
+
+        arena::vector<StackId>& candidates = stacks_by_hash[hashFrames(stack, size)];
+        for (StackId id : candidates) {
+            StackEntry const& entry = entries[id];
+            if (entry.size == (uint32_t)size && entry.site == site && std::equal(stack, stack + size, frames.begin() + entry.offset))
+                return id;
+        }
+
+        StackId id = entries.size();
+        entries.push_back({(uint32_t)frames.size(), (uint32_t)size, site});
+        frames.insert(frames.end(), stack, stack + size);
+        candidates.push_back(id);
+        return id;
+    }
+
+    bool capturesCallers() { return max_depth > 1; }
+
+    std::vector<CodePtr> get(StackId id) {
+        if (id == 0 || id >= entries.size()) return {};
+        StackEntry const& entry = entries[id];
+        return std::vector<CodePtr>(frames.begin() + entry.offset, frames.begin() + entry.offset + entry.size);
+    }
+
+    SiteId getSite(StackId id) {
+        if (id == 0 || id >= entries.size()) return COVER_DB_NONE;
+        return entries[id].site;
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "DynamicUtils.h"
+#include <vector>
+
+/*
+ * Deduplicating storage for call stacks of reported locations.
+ * Analyses only keep the 32-bit StackId, frames are resolved when a violation is printed.
+ * By default, stacks consist of the callback location only, and are only stored once an analysis references them.
+ * Set COVER_STACK_DEPTH for deeper stacks, which are captured at each function callback.
+ */
+namespace StackDepot {
+    // Read configuration
+    void Initialize();
+
+    // Capture the stack of the instrumented code calling back into the runtime.
+    // location is the return address of the callback, runtime frames above it are dropped.
+    // site is the instrumented site of the callback, used to resolve the innermost frame.
+    StackId capture(CodePtr location, SiteId site);
+
+    // Whether stacks need to be captured while the callback runs, i.e. consist of more than the location
+    bool capturesCallers();
+
+    // Stack of a callsite, captured from its location if not captured during the callback
+    inline StackId of(CallsiteInfo const& callsite) {
+        return callsite.stack ? callsite.stack : capture(callsite.location, callsite.site);
+    }
+
+    // Get frames of a stack, innermost first. Empty for the invalid stack id 0.
+    std::vector<CodePtr> get(StackId id);
+
+    // Get the site of the innermost frame
+    SiteId getSite(StackId id);
+}
@@ -0,0 +1,136 @@
+#include "WatchSet.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+    constexpr uintptr_t WATCH_PAGE_SHIFT = 12;
+    constexpr uintptr_t WATCH_MAX_FILTER_PAGES = 256; // Larger ranges are always scanned
+    constexpr size_t WATCH_SIMD_MIN_SIZE = 8; // Below, the scalar loop exits earlier than the vector setup
+
+    WatchSetKernels::FindKernel selectFindKernel() {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return WatchSetKernels::findAVX2;
+#endif
+        // SSE2 lacks a 64-bit compare, and emulating it was slower than the scalar loop (see Benchmarks/)
+        return WatchSetKernels::findScalar;
+    }
+
+    WatchSetKernels::FindKernel const findKernel = selectFindKernel();
+}
+
+namespace WatchSetKernels {
+    int32_t findScalar(uintptr_t const* starts, uintptr_t const* lengths, size_t size, uintptr_t addr) {
+        for (size_t i = 0; i < size; i++) {
+            if (addr - starts[i] < lengths[i]) return i;
+        }
+        return WatchSet::NOT_FOUND;
+    }
+
+#if defined(__x86_64__)
+    __attribute__((target("avx2")))
+    int32_t findAVX2(uintptr_t const* starts, uintptr_t const* lengths, size_t size, uintptr_t addr) {
+        // Unsigned compare via signed compare of sign-flipped values
+        __m256i const sign = _mm256_set1_epi64x(INT64_MIN);
+        __m256i const vaddr = _mm256_set1_epi64x(addr);
+        size_t i = 0;
+        for (; i + 4 <= size; i += 4) {
+            __m256i diff = _mm256_sub_epi64(vaddr, _mm256_loadu_si256((__m256i const*)&starts[i]));
+            __m256i len = _mm256_loadu_si256((__m256i const*)&lengths[i]);
+            __m256i lt = _mm256_cmpgt_epi64(_mm256_xor_si256(len, sign), _mm256_xor_si256(diff, sign));
+            int mask = _mm256_movemask_pd(_mm256_castsi256_pd(lt));
+            if (mask) [[unlikely]] return i + __builtin_ctz(mask);
+        }
+        int32_t tail = findScalar(starts + i, lengths + i, size - i, addr);
+        return tail == WatchSet::NOT_FOUND ? tail : i + tail;
+    }
+#else
+    int32_t findAVX2(uintptr_t const* starts, uintptr_t const* lengths, size_t size, uintptr_t addr) {
+        return findScalar(starts, lengths, size, addr);
+    }
+#endif
+
+    FindKernel selected() {
+        return findKernel;
+    }
+}
+
+void WatchSet::addPages(uintptr_t start, uintptr_t length) {
+    uintptr_t first = start >> WATCH_PAGE_SHIFT;
+    uintptr_t last = (start + length - 1) >> WATCH_PAGE_SHIFT;
+    if (last - first >= WATCH_MAX_FILTER_PAGES) {
+        unfiltered++;
+        return;
+    }
+    for (uintptr_t page = first; page <= last; page++) pages[page]++;
+}
+
+void WatchSet::removePages(uintptr_t start, uintptr_t length) {
+    uintptr_t first = start >> WATCH_PAGE_SHIFT;
+    uintptr_t last = (start + length - 1) >> WATCH_PAGE_SHIFT;
+    if (last - first >= WATCH_MAX_FILTER_PAGES) {
+        unfiltered--;
+        return;
+    }
+    for (uintptr_t page = first; page <= last; page++) {
+        auto it = pages.find(page);
+        if (--it->second == 0) pages.erase(it);
+    }
+}
+
+void WatchSet::push_back(uintptr_t start, uintptr_t length) {
+    starts.push_back(start);
+    lengths.push_back(length);
+    addPages(start, length);
+}
+
+void WatchSet::set(size_t idx, uintptr_t start, uintptr_t length) {
+    removePages(starts[idx], lengths[idx]);
+    starts[idx] = start;
+    lengths[idx] = length;
+    addPages(start, length);
+}
+
+void WatchSet::erase(size_t idx) {
+    removePages(starts[idx], lengths[idx]);
+    starts.erase(starts.begin() + idx);
+    lengths.erase(lengths.begin() + idx);
+}
+
+void WatchSet::clear() {
+    starts.clear();
+    lengths.clear();
+    pages.clear();
+    unfiltered = 0;
+}
+
+int32_t WatchSet::find(uintptr_t addr) const {
+    if (starts.size() > PAGE_FILTER_THRESHOLD && !unfiltered && !pages.contains(addr >> WATCH_PAGE_SHIFT))
+        return NOT_FOUND;
+    if (starts.size() < WATCH_SIMD_MIN_SIZE)
+        return WatchSetKernels::findScalar(starts.data(), lengths.data(), starts.size(), addr);
+    return findKernel(starts.data(), lengths.data(), starts.size(), addr);
+}
+
+int32_t WatchSet::findStrided(uintptr_t base, int64_t count, int64_t stride) const {
+    if (count <= 0) return NOT_FOUND;
+    if (count == 1 || stride == 0) return find(base);
+    if (stride < 0) {
+        // Same addresses, walked upwards from the last one
+        base += (count - 1) * stride;
+        stride = -stride;
+    }
+    uintptr_t end = base + (count - 1) * stride; // Last accessed address
+    for (size_t i = 0; i < starts.size(); i++) {
+        if (starts[i] > end || starts[i] + lengths[i] <= base) continue;
+        // First accessed address at or after the start of the entry
+        uintptr_t k = starts[i] > base ? (starts[i] - base + stride - 1) / stride : 0;
+        if (base + k * stride - starts[i] < lengths[i]) return i;
+    }
+    return NOT_FOUND;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Arena.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Set of watched memory ranges, queried on every instrumented memory access.
+ * Entries keep their insertion order, so owners can keep per-entry state in parallel arrays.
+ * Small sets are scanned with a SIMD kernel selected by CPU features at startup.
+ * Large sets are prefiltered by a hashed map of the watched pages.
+ */
+class WatchSet {
+    public:
+        static constexpr int32_t NOT_FOUND = -1;
+        // Above this size, a lookup first checks the page map
+        static constexpr size_t PAGE_FILTER_THRESHOLD = 64;
+
+        void push_back(uintptr_t start, uintptr_t length = 1);
+        void set(size_t idx, uintptr_t start, uintptr_t length = 1);
+        void erase(size_t idx);
+        void clear();
+
+        size_t size() const { return starts.size(); }
+        bool empty() const { return starts.empty(); }
+        uintptr_t const& start(size_t idx) const { return starts[idx]; }
+        uintptr_t const& length(size_t idx) const { return lengths[idx]; }
+
+        // Index of the first entry containing addr, or NOT_FOUND
+        int32_t find(uintptr_t addr) const;
+
+        // Index of the first entry containing any of base + i * stride for i < count, or NOT_FOUND
+        int32_t findStrided(uintptr_t base, int64_t count, int64_t stride) const;
+
+    private:
+        void addPages(uintptr_t start, uintptr_t length);
+        void removePages(uintptr_t start, uintptr_t length);
+
+        // Structure of arrays for the scan kernels
+        arena::vector<uintptr_t> starts;
+        arena::vector<uintptr_t> lengths;
+
+        arena::unordered_map<uintptr_t, uint32_t> pages; // Page -> number of entries on page
+        int32_t unfiltered = 0; // Entries too large for the page map
+};
+
+namespace WatchSetKernels {
+    // Index of first i with start[i] <= addr < start[i] + length[i], or WatchSet::NOT_FOUND
+    using FindKernel = int32_t (*)(uintptr_t const* starts, uintptr_t const* lengths, size_t size, uintptr_t addr);
+
+    int32_t findScalar(uintptr_t const* starts, uintptr_t const* lengths, size_t size, uintptr_t addr);
+    int32_t findAVX2(uintptr_t const* starts, uintptr_t const* lengths, size_t size, uintptr_t addr);
+
+    // Kernel chosen for this CPU
+    FindKernel selected();
+}
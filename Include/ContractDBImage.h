@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Serialized form of the contract database, as emitted by the instrumentation pass.
+ * All records live in a single read-only blob starting with DBHeader_t.
+ * Records reference each other by byte offset into the blob, strings by offset into its string table.
+ * Functions are referenced by index into the function table of the image, which is the only part requiring relocations.
+ * Source locations of the instrumented sites are stored in a separate table, as it is only complete after instrumentation.
+ * The runtime decodes the image into the structures of DynamicAnalysis.h on initialization.
+ */
+
+#define COVER_DB_MAGIC 0x42445643 // "CVDB"
+#define COVER_DB_VERSION 6
+#define COVER_DB_NONE UINT32_MAX // Absent offset or function index
+
+struct DBHeader_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t contracts; // DBContract_t[num_contracts]
+    uint32_t num_contracts;
+    uint32_t tags; // DBTag_t[num_tags]
+    uint32_t num_tags;
+    uint32_t references; // DBReference_t[num_references]
+    uint32_t num_references;
+    uint32_t strings; // String table, NUL-terminated and deduplicated
+    uint32_t strings_size;
+};
+
+struct DBCallParam_t {
+    int32_t callP;
+    int32_t callPisTagVar;
+    int32_t contrP;
+    int32_t accType;
+};
+
+struct DBRWOp_t {
+    int32_t idx;
+    int32_t accType;
+    int32_t isWrite;
+};
+struct DBCallOp_t {
+    uint32_t function_name; // String
+    uint32_t params; // DBCallParam_t[num_params]
+    uint32_t num_params;
+    uint32_t target_function; // Function index, COVER_DB_NONE if not in module
+};
+struct DBCallTagOp_t {
+    uint32_t target_tag; // String
+    uint32_t params; // DBCallParam_t[num_params]
+    uint32_t num_params;
+};
+struct DBReleaseOp_t {
+    uint32_t release_op; // Operation record of kind release_op_kind
+    int32_t release_op_kind;
+    uint32_t forbidden_op;
+    int32_t forbidden_op_kind;
+};
+
+struct DBFormula_t {
+    uint32_t children; // DBFormula_t[num_children]
+    uint32_t num_children;
+    int32_t conn; // ContractConnective
+    uint32_t msg; // String
+    uint32_t data; // Operation record, only if conn is unary
+    int32_t verdict_bit; // Bit set in the proven mask of supplier callsites statically shown to satisfy this expression, -1 if none
+};
+
+struct DBContract_t {
+    uint32_t precondition; // DBFormula_t, COVER_DB_NONE if absent
+    uint32_t postcondition;
+    uint32_t function; // Function index
+    uint32_t function_name; // String
+};
+
+struct DBTag_t {
+    uint32_t function; // Function index
+    uint32_t tag; // String
+    int32_t param;
+};
+
+struct DBReference_t {
+    uint32_t ref; // String
+    uint32_t type; // String
+    uint32_t counter; // Index into the coverage counters, shared by references to the same location
+};
+
+// Location of an instrumented site. Callbacks pass the index of their site
+struct DBSite_t {
+    uint32_t file; // Offset into the site table, COVER_DB_NONE if no debug info
+    uint32_t line;
+    uint32_t column;
+};
+
+// Passed to PPDCV_RegisterModule by each instrumented module
+struct ContractDBImage_t {
+    uint8_t const* blob;
+    uint32_t size;
+    void* const* functions;
+    int32_t* gates; // Callback gate of each function, maintained by the runtime
+    uint32_t num_functions;
+    uint8_t* counters; // Saturating hit count of each relevant location, incremented inline by instrumented code
+    uint32_t num_counters;
+    uint8_t const* sites; // DBSite_t[num_sites], followed by the NUL-terminated file names
+    uint32_t num_sites;
+    uint32_t const* num_calls; // Number of instrumented callsites of each function, i.e. the range of its call ids
+};
@@ -44,6 +44,7 @@ namespace ContractPassUtility {
     * Format: <module>:<line> or UNKNOWN depending on output of getLineNumber
     */
     std::optional<uint> getLineNumber(const Instruction* I);
+    std::string getFile(const Instruction* I);
     std::string getInstrLocStr(const Instruction* I);
     FileReference getFileReference(const Instruction* I);
 
@@ -10,9 +10,12 @@
 #include <string>
 #include <memory>
 #include <optional>
+#include <set>
 #include <utility>
 #include <vector>
 
+namespace llvm { class CallBase; }
+
 namespace ContractTree {
     enum struct OperationType { READ, WRITE, CALL, CALLTAG, RELEASE };
     enum struct ParamAccess { NORMAL, DEREF, ADDROF };
@@ -69,6 +72,7 @@ namespace ContractTree {
         std::shared_ptr<Fulfillment> Status = std::make_shared<Fulfillment>(Fulfillment::UNKNOWN);
         std::optional<ErrorMessage> Message;
         std::shared_ptr<std::vector<ErrorMessage>> ErrorInfo = std::make_shared<std::vector<ErrorMessage>>();
+        std::shared_ptr<std::set<llvm::CallBase const*>> SafeCallsites = std::make_shared<std::set<llvm::CallBase const*>>(); // Supplier callsites proven not to violate this formula
         virtual ~ContractFormula() = default;
     };
     struct ContractExpression : ContractFormula {
@@ -1,12 +1,13 @@
 #pragma once
 
 #include <stdint.h>
+#include "ContractDBImage.h"
 
 /*
  * This is a simplified version of the ContractTree,
  * using c-native types.
- * This representation is generated by the instrumentation pass
- * for use with dynamic tools.
+ * This representation is decoded from the image generated by the instrumentation pass
+ * for use with dynamic tools, see ContractDBImage.h.
  */
 
 struct Tag_t {
@@ -61,6 +62,7 @@ struct ContractFormula_t {
     ContractConnective conn;
     const char* msg;
     void** data; // Only filled if conn == UNARY. Pointer to corresponding operation struct.
+    int32_t verdict_bit; // See DBFormula_t
 };
 
 struct Contract_t {
@@ -73,6 +75,14 @@ struct Contract_t {
 struct Reference_t {
     const char* ref;
     const char* type;
+    uint8_t const* counter; // Hit count of the location, shared by references to the same location
+};
+
+// Instrumented callee, indexed by the callee id passed to function callbacks
+struct Callee_t {
+    void* function;
+    int32_t* gate; // Function callbacks of the callee are skipped while zero. Maintained by the runtime
+    uint32_t num_calls; // Call ids of its callsites are below this
 };
 
 struct ContractDB_t {
@@ -81,17 +91,33 @@ struct ContractDB_t {
     TagsMap_t tagMap;
     Reference_t* references;
     int32_t num_references;
+    Callee_t* callees;
+    int32_t num_callees;
+    ContractDBImage_t const* image; // Image of the module this database was decoded from
 };
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Memory callbacks are skipped while the gate of their kind is zero, i.e. no buffer is watched
+extern int32_t PPDCV_MemRGate;
+extern int32_t PPDCV_MemWGate;
+// Lowest and highest address of the buffers watched through memory callbacks, empty while the lowest is above the highest
+extern uintptr_t PPDCV_MemRBounds[2];
+extern uintptr_t PPDCV_MemWBounds[2];
+// Sampled memory callback sites only call back every this many executions
+extern int32_t PPDCV_SamplePeriod;
+
 // Callback function declarations
-void PPDCV_Initialize(int32_t* argc, char*** argv, ContractDB_t const* DB);
-void PPDCV_FunctionCallback(bool isRel, void* function, int32_t num_params, ...); // relevancy, funcptr, num params, then sizeof param and param each
-void PPDCV_MemRCallback(bool const isRel, void const* buf);
-void PPDCV_MemWCallback(bool const isRel, void const* buf);
+void PPDCV_RegisterModule(ContractDBImage_t const* image); // Called by a constructor of each instrumented module, including dlopened ones
+void PPDCV_Initialize(int32_t* argc, char*** argv); // Called on entry of main, analyses the modules registered until then and all later ones
+void PPDCV_FunctionCallback(uint32_t site, ContractDBImage_t const* module, uint32_t callee, uint32_t call, uint64_t proven, int32_t const* param_idx, int32_t num_params, ...); // site id, image of the calling module, callee id and call id within that module, verdict bits of expressions proven for this callsite, ascending indices of passed params, num params, then sizeof param and param each
+void PPDCV_FunctionWrapperCallback(void const* location, ContractDBImage_t const* module, uint32_t callee, int32_t const* param_idx, int32_t num_params, ...); // return address of the wrapper, then as above
+void PPDCV_MemRCallback(uint32_t site, void const* buf);
+void PPDCV_MemWCallback(uint32_t site, void const* buf);
+void PPDCV_MemRangeRCallback(uint32_t site, void const* base, int64_t count, int64_t stride); // Accesses base + i * stride for i < count
+void PPDCV_MemRangeWCallback(uint32_t site, void const* base, int64_t count, int64_t stride);
 
 #ifdef __cplusplus
 }
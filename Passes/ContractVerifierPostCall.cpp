@@ -127,20 +127,27 @@ ContractVerifierPostCallPass::CallStatus ContractVerifierPostCallPass::checkPost
     ContractPassUtility::TransferFunction<CallStatus> transfer = std::bind(&ContractVerifierPostCallPass::transferPostCallStat, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
     ContractPassUtility::MergeFunction<CallStatus> merge = std::bind(&ContractVerifierPostCallPass::mergePostCallStat, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4);
 
+    // Every callsite is checked, so that the runtime can skip the ones proven safe
+    CallStatus result = CallStatus::CALLED;
     for (const User* U : C.F->users()) {
         if (const CallBase* CB = dyn_cast<CallBase>(U)) {
             if (CB->getCalledOperand() == C.F) {
                 data.callsite = CB;
                 std::map<const Instruction *, CallStatus> AnalysisInfo = ContractPassUtility::GenericWorklist<CallStatus>(CB->getNextNode(), transfer, merge, &data, CallStatus::NOTCALLED);
-                C.DebugInfo->insert(C.DebugInfo->end(), data.dbg.begin(), data.dbg.end());
+                if (result == CallStatus::CALLED) C.DebugInfo->insert(C.DebugInfo->end(), data.dbg.begin(), data.dbg.end());
+                bool safe = true;
                 for (std::pair<const Instruction *, CallStatus> x : AnalysisInfo) {
                     if (isa<ReturnInst>(x.first) && x.first->getParent()->getParent()->getName() == "main" && x.second == CallStatus::NOTCALLED) {
-                        appendDebugStr(cOP->Function, isTag, data.callsite, data.dbg_candidates, *Expr.ErrorInfo);
-                        return CallStatus::NOTCALLED;
+                        // Only report the first failing callsite
+                        if (result == CallStatus::CALLED) appendDebugStr(cOP->Function, isTag, data.callsite, data.dbg_candidates, *Expr.ErrorInfo);
+                        result = CallStatus::NOTCALLED;
+                        safe = false;
+                        break;
                     }
                 }
+                if (safe) Expr.SafeCallsites->insert(CB);
             }
         }
     }
-    return CallStatus::CALLED;
+    return result;
 }
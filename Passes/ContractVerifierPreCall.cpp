@@ -173,6 +173,7 @@ ContractVerifierPreCallPass::CallStatusVal ContractVerifierPreCallPass::checkPre
         if (const CallBase* CB = dyn_cast<CallBase>(AI.first)) {
             if (CB->getCalledOperand() == C.F) {
                 res = std::max(AI.second.CurVal, res);
+                if (AI.second.CurVal == CallStatusVal::CALLED) Expr.SafeCallsites->insert(CB);
             }
         }
     }
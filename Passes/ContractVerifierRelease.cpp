@@ -204,20 +204,27 @@ ContractVerifierReleasePass::ReleaseStatus ContractVerifierReleasePass::checkRel
     ContractPassUtility::MergeFunction<ReleaseStatus> merge = std::bind(&ContractVerifierReleasePass::mergeRelease, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4);
 
     // Get all call sites of function, and run analysis
-    ReleaseStatus result = ReleaseStatus::FORBIDDEN;
+    // Every callsite is checked, so that the runtime can skip the ones proven safe
+    ReleaseStatus result = ReleaseStatus::FULFILLED;
     for (const User* U : C.F->users()) {
         if (const CallBase* CB = dyn_cast<CallBase>(U)) {
             if (CB->getCalledOperand() == C.F) {
                 data.callsite = CB;
                 std::map<const Instruction *, ReleaseStatus> AnalysisInfo = ContractPassUtility::GenericWorklist<ReleaseStatus>(CB->getNextNode(), transfer, merge, &data, ReleaseStatus::FORBIDDEN);
-                C.DebugInfo->insert(C.DebugInfo->end(), data.dbg.begin(), data.dbg.end());
-                Expr.ErrorInfo->insert(Expr.ErrorInfo->end(), data.err.begin(), data.err.end());
+                // Only report the first failing callsite
+                if (result != ReleaseStatus::ERROR) {
+                    C.DebugInfo->insert(C.DebugInfo->end(), data.dbg.begin(), data.dbg.end());
+                    Expr.ErrorInfo->insert(Expr.ErrorInfo->end(), data.err.begin(), data.err.end());
+                }
                 data.err.clear();
+                bool safe = true;
                 for (std::pair<const Instruction *, ReleaseStatus> x : AnalysisInfo) {
-                    if (x.second >= ReleaseStatus::ERROR_UNFULFILLED) return ReleaseStatus::ERROR;
+                    if (x.second >= ReleaseStatus::ERROR_UNFULFILLED) safe = false;
                 }
+                if (safe) Expr.SafeCallsites->insert(CB);
+                else result = ReleaseStatus::ERROR;
             }
         }
     }
-    return ReleaseStatus::FULFILLED;
+    return result;
 }
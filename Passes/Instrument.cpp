@@ -8,9 +8,13 @@
 #include <fstream>
 #include <json/reader.h>
 #include <json/value.h>
+#include <json/writer.h>
 #include <llvm/ADT/APInt.h>
 #include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/StringRef.h>
+#include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/Analysis/CaptureTracking.h>
+#include <llvm/Analysis/ValueTracking.h>
 #include <llvm/IR/Attributes.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constant.h>
@@ -18,21 +22,37 @@
 #include <llvm/IR/DebugInfoMetadata.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/GlobalValue.h>
 #include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/InstrTypes.h>
 #include <llvm/IR/Instruction.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Demangle/Demangle.h>
 #include <llvm/IR/Operator.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Linker/Linker.h>
 #include <llvm/Support/Casting.h>
 #include <llvm/Support/Compiler.h>
 #include <llvm/Support/ErrorHandling.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/SpecialCaseList.h>
+#include <llvm/Support/VirtualFileSystem.h>
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
 #include <llvm/Support/WithColor.h>
 #include <dwarf.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <memory>
+#include <optional>
+#include <sstream>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -43,16 +63,108 @@ using namespace ContractTree;
 
 static cl::opt<std::string> ClInstrumentType(
     "cover-instrument-type", cl::init("full"),
-    cl::desc("Kind of instrumentation to apply. Choices: full, filtered[=<detection json>], funconly"),
+    cl::desc("Kind of instrumentation to apply. Choices: full, filtered[=<detection json>], profile=<training profile>, funconly"),
+    cl::Hidden);
+
+static cl::opt<bool> ClPruneFulfilled(
+    "cover-prune-fulfilled", cl::init(true),
+    cl::desc("Do not check contract formulas at runtime which were statically proven to be fulfilled"),
+    cl::Hidden);
+
+static cl::opt<bool> ClStaticVerdicts(
+    "cover-static-verdicts", cl::init(true),
+    cl::desc("Tell the runtime which supplier callsites were statically proven to satisfy an expression"),
+    cl::Hidden);
+
+static cl::opt<bool> ClElideUnwatchedAccesses(
+    "cover-elide-unwatched-accesses", cl::init(true),
+    cl::desc("Do not instrument memory accesses that cannot touch a buffer watched by a read!/write! contract"),
+    cl::Hidden);
+
+static cl::opt<bool> ClRestrictToRegions(
+    "cover-restrict-to-regions", cl::init(false),
+    cl::desc("Only instrument memory accesses that may execute between a supplier call and the release of its read!/write! contract"),
+    cl::Hidden);
+
+static cl::opt<bool> ClHoistLoopAccesses(
+    "cover-hoist-loop-accesses", cl::init(true),
+    cl::desc("Replace callbacks for strided accesses in innermost loops by a single range callback before the loop"),
+    cl::Hidden);
+
+static cl::opt<bool> ClCloneCleanFunctions(
+    "cover-clone-clean-functions", cl::init(false),
+    cl::desc("Keep an uninstrumented copy of functions with memory callbacks that cannot reach a contract function, used while no buffer is watched"),
+    cl::Hidden);
+
+static cl::opt<unsigned> ClCloneSizeLimit(
+    "cover-clone-size-limit", cl::init(20),
+    cl::desc("Maximum code size increase by uninstrumented copies, in percent of the module instructions"),
+    cl::Hidden);
+
+static cl::opt<std::string> ClInstrumentWrappers(
+    "cover-instrument-wrappers", cl::init(""),
+    cl::desc("Instrument calls to contract-relevant C functions in one wrapper per function instead of at each callsite. Choices: redirect, interpose"),
+    cl::Hidden);
+
+static cl::opt<bool> ClSampleMemory(
+    "cover-sample-memory", cl::init(false),
+    cl::desc("Only perform every n-th memory callback of each site, with n adjusted by the runtime to stay within an overhead budget"),
+    cl::Hidden);
+
+static cl::opt<std::string> ClFastPathBitcode(
+    "cover-fast-path-bitcode", cl::init(""),
+    cl::desc("Bitcode file with inlinable fast paths of the memory callbacks, linked into the module after static analysis"),
+    cl::Hidden);
+
+static cl::list<std::string> ClIgnorelist(
+    "cover-ignorelist",
+    cl::desc("Special case list of functions (fun:), source files (src:) and modules (mainfile:) to leave uninstrumented"),
+    cl::Hidden);
+
+static cl::list<std::string> ClAllowlist(
+    "cover-allowlist",
+    cl::desc("Special case list of the only functions (fun:), source files (src:) and modules (mainfile:) to instrument"),
+    cl::Hidden);
+
+static cl::opt<std::string> ClInstrumentReport(
+    "cover-instrument-report", cl::init(""),
+    cl::desc("Write the inserted callbacks per function and their estimated dynamic count to the specified JSON file, and print a summary"),
+    cl::Hidden);
+
+static cl::opt<unsigned> ClReportLoopWeight(
+    "cover-report-loop-weight", cl::init(10),
+    cl::desc("Assumed number of iterations of each loop when estimating dynamic callback counts"),
+    cl::Hidden);
+
+static cl::opt<bool> ClGateCallbacks(
+    "cover-gate-callbacks", cl::init(true),
+    cl::desc("Skip callbacks inline while the runtime does not need them"),
     cl::Hidden);
 
 PreservedAnalyses InstrumentPass::run(Module &M,
                                             ModuleAnalysisManager &AM) {
     DB = &AM.getResult<ContractManagerAnalysis>(M);
+    auto const start_time = std::chrono::system_clock::now();
 
+    // Modules without main, e.g. shared libraries, only register their contract database
     Function* mainF = M.getFunction("main");
-    if (!mainF) return PreservedAnalyses::all(); // No point
+    if (mainF && mainF->isDeclaration()) mainF = nullptr;
     if (M.getFunction("_QQmain")) isC = false; // TODO: Switch to DISourceLanguage check once released
+    if (!ClInstrumentWrappers.empty() && ClInstrumentWrappers != "redirect" && ClInstrumentWrappers != "interpose") {
+        WithColor(errs(), HighlightColor::Error) << "Unknown wrapper mode \"" << ClInstrumentWrappers << "\"!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // Read ignorelist and allowlist
+    std::string list_err;
+    if (!ClIgnorelist.empty() && !(ignorelist = SpecialCaseList::create(ClIgnorelist, *vfs::getRealFileSystem(), list_err))) {
+        WithColor(errs(), HighlightColor::Error) << "Could not read ignorelist: " << list_err << "\n";
+        exit(EXIT_FAILURE);
+    }
+    if (!ClAllowlist.empty() && !(allowlist = SpecialCaseList::create(ClAllowlist, *vfs::getRealFileSystem(), list_err))) {
+        WithColor(errs(), HighlightColor::Error) << "Could not read allowlist: " << list_err << "\n";
+        exit(EXIT_FAILURE);
+    }
 
     // Read detJson
     Json::Value detJson;
@@ -71,6 +183,20 @@ PreservedAnalyses InstrumentPass::run(Module &M,
     } else {
         detJson = DB->processedReports;
     }
+    // Read profile of a training run, see Dynamic/Profile.h
+    if (ClInstrumentType.starts_with("profile=")) {
+        std::ifstream profile_in(ClInstrumentType.substr(8, std::string::npos));
+        if (!profile_in) {
+            WithColor(errs(), HighlightColor::Error) << "Given profile could not be opened!\nEnsure the path is correct!\n";
+            exit(EXIT_FAILURE);
+        }
+        std::string line;
+        while (std::getline(profile_in, line)) {
+            if (line.starts_with("file ")) profile_files.insert(line.substr(5));
+            else if (line.starts_with("read ") || line.starts_with("write ")) profile_hot_sites.insert(line);
+        }
+        errs() << "CoVer: Read profile with " << profile_hot_sites.size() << " memory sites accessed during release windows in " << profile_files.size() << " source files\n";
+    }
     // Fill references
     for (Json::Value msg_j : detJson["messages"]) {
         ErrorMessage msg = {msg_j["type"].asString(), msg_j["error_id"].asString(), msg_j["text"].asString()};
@@ -80,6 +206,8 @@ PreservedAnalyses InstrumentPass::run(Module &M,
                 ref["line"].asUInt(),
                 ref["column"].asUInt()
             });
+            auto counter = reference_counters.try_emplace(msg.references.back(), reference_counters.size()).first;
+            reference_locations.try_emplace({getFileId(counter->first.file), counter->first.line, counter->first.column}, counter->second);
         }
         err_msgs.push_back(msg);
     }
@@ -87,53 +215,58 @@ PreservedAnalyses InstrumentPass::run(Module &M,
     // Generic Types and consts
     createTypes(M);
 
-    // Create Tag globals
-    Constant* TagVal;
-    TagVal = createTagGlobal(M);
-
-    // Create reference globals
-    Constant* ReferencesVal;
-    uint64_t num_refs;
-    std::tie(ReferencesVal, num_refs) = createReferencesGlobal(M);
-
-    // Create Contract globals
-    Constant* ContractsVal;
-    uint64_t num_contrs;
-    std::tie(ContractsVal, num_contrs) = createContractsGlobal(M);
-
-    // Package database
-    GlobalVariable* GlobalDB = dyn_cast<GlobalVariable>(M.getOrInsertGlobal("CONTR_DB", DB_Type));
-    Constant* CDB = ConstantStruct::get(DB_Type, {ContractsVal, ConstantInt::get(Int_Type, num_contrs),  TagVal, ReferencesVal, ConstantInt::get(Int_Type, num_refs)});
-    GlobalDB->setInitializer(CDB);
+    // Serialize contract database
+    GlobalDB = createImageGlobal(M);
 
     AttributeList fnAttr;
     fnAttr = fnAttr.addFnAttribute(M.getContext(), Attribute::NoUnwind);
     fnAttr = fnAttr.addFnAttribute(M.getContext(), Attribute::WillReturn);
     fnAttr = fnAttr.addFnAttribute(M.getContext(), Attribute::NoCallback);
 
-    // Create initialization routine for tool
-    FunctionType* InitCBType = FunctionType::get(Void_Type, {Ptr_Type, Ptr_Type, Ptr_Type}, false);
-    FunctionCallee initFuncCallee = M.getOrInsertFunction("PPDCV_Initialize", InitCBType, fnAttr);
-    Function* initFunc = dyn_cast<Function>(initFuncCallee.getCallee());
-    initFunc->setLinkage(GlobalValue::ExternalWeakLinkage);
-    Value* Vargc = mainF->getArg(0);
-    Value* Vargv = mainF->getArg(1);
-    Value* argcptr = new AllocaInst(Int_Type, 0, "argc_ptr", mainF->getEntryBlock().getFirstNonPHIOrDbg());
-    Value* argvptr = new AllocaInst(Ptr_Type, 0, "argv_ptr", mainF->getEntryBlock().getFirstNonPHIOrDbg());
-    CallInst* initFuncCI = CallInst::Create(initFuncCallee, {argcptr, argvptr, GlobalDB});
-    initFuncCI->insertBefore(mainF->getEntryBlock().getFirstNonPHIOrDbgOrAlloca());
-    instrument_ignore.insert(new StoreInst(Vargc, argcptr, initFuncCI->getIterator()));
-    instrument_ignore.insert(new StoreInst(Vargv, argvptr, initFuncCI->getIterator()));
+    // Each module registers its contract database in a constructor, so that executables and shared libraries can be instrumented separately
+    FunctionType* RegisterCBType = FunctionType::get(Void_Type, {Ptr_Type}, false);
+    FunctionCallee registerFuncCallee = M.getOrInsertFunction("PPDCV_RegisterModule", RegisterCBType, fnAttr);
+    dyn_cast<Function>(registerFuncCallee.getCallee())->setLinkage(GlobalValue::ExternalWeakLinkage);
+    Function* registerCtor = Function::Create(FunctionType::get(Void_Type, false), GlobalValue::InternalLinkage, "cover.register_module", M);
+    BasicBlock* registerBB = BasicBlock::Create(M.getContext(), "entry", registerCtor);
+    CallInst::Create(registerFuncCallee, {GlobalDB}, "", registerBB);
+    ReturnInst::Create(M.getContext(), registerBB);
+    appendToGlobalCtors(M, registerCtor, 65535);
+
+    // Create initialization routine for tool, which analyses all modules registered so far
+    if (mainF) {
+        FunctionType* InitCBType = FunctionType::get(Void_Type, {Ptr_Type, Ptr_Type}, false);
+        FunctionCallee initFuncCallee = M.getOrInsertFunction("PPDCV_Initialize", InitCBType, fnAttr);
+        Function* initFunc = dyn_cast<Function>(initFuncCallee.getCallee());
+        initFunc->setLinkage(GlobalValue::ExternalWeakLinkage);
+        Value* Vargc = mainF->getArg(0);
+        Value* Vargv = mainF->getArg(1);
+        Value* argcptr = new AllocaInst(Int_Type, 0, "argc_ptr", mainF->getEntryBlock().getFirstNonPHIOrDbg());
+        Value* argvptr = new AllocaInst(Ptr_Type, 0, "argv_ptr", mainF->getEntryBlock().getFirstNonPHIOrDbg());
+        CallInst* initFuncCI = CallInst::Create(initFuncCallee, {argcptr, argvptr});
+        initFuncCI->insertBefore(mainF->getEntryBlock().getFirstNonPHIOrDbgOrAlloca());
+        instrument_ignore.insert(new StoreInst(Vargc, argcptr, initFuncCI->getIterator()));
+        instrument_ignore.insert(new StoreInst(Vargv, argvptr, initFuncCI->getIterator()));
+    }
+    // All callbacks pass their site id first, indexing the site table of the image
     // Create callback function for rel func call
-    // Call sig: Function ptr, num operands, vararg list of operands. Format: {int64-as-bool isptr, size of param, param} for each param.
-    FunctionType* FunctionCBType = FunctionType::get(Void_Type, {Bool_Type, Ptr_Type, Int_Type}, true);
+    // Call sig: Image of this module, callee id, call id, proven verdict bits, parameter index map, num operands, vararg list of operands. Format: {size of param, param} for each param in the index map.
+    // Callee ids index the function table of the image, call ids number the instrumented callsites of each callee. The runtime maps both to ids across modules
+    FunctionType* FunctionCBType = FunctionType::get(Void_Type, {Int_Type, Ptr_Type, Int_Type, Int_Type, Int64_Type, Ptr_Type, Int_Type}, true);
     callbackFuncCallee = M.getOrInsertFunction("PPDCV_FunctionCallback", FunctionCBType, fnAttr);
     Function* callbackFunc = dyn_cast<Function>(callbackFuncCallee.getCallee());
     callbackFunc->setLinkage(GlobalValue::ExternalWeakLinkage);
 
+    // Create callback function for calls seen by a wrapper, see insertFunctionWrapper
+    // Call sig: Return address of the wrapper, image of this module, callee id, parameter index map, num operands, vararg list of operands. No site id
+    FunctionType* FunctionWrapperCBType = FunctionType::get(Void_Type, {Ptr_Type, Ptr_Type, Int_Type, Ptr_Type, Int_Type}, true);
+    callbackWrapperCallee = M.getOrInsertFunction("PPDCV_FunctionWrapperCallback", FunctionWrapperCBType, fnAttr);
+    Function* callbackWrapper = dyn_cast<Function>(callbackWrapperCallee.getCallee());
+    callbackWrapper->setLinkage(GlobalValue::ExternalWeakLinkage);
+
     // Create callback function for RW
-    // Call sig: int64-as-bool isWrite, mem ptr
-    FunctionType* FunctionRWType = FunctionType::get(Void_Type, {Bool_Type, Ptr_Type}, false);
+    // Call sig: mem ptr
+    FunctionType* FunctionRWType = FunctionType::get(Void_Type, {Int_Type, Ptr_Type}, false);
     callbackRCallee = M.getOrInsertFunction("PPDCV_MemRCallback", FunctionRWType, fnAttr);
     Function* callbackR = dyn_cast<Function>(callbackRCallee.getCallee());
     callbackR->setLinkage(GlobalValue::ExternalWeakLinkage);
@@ -141,336 +274,1115 @@ PreservedAnalyses InstrumentPass::run(Module &M,
     Function* callbackW = dyn_cast<Function>(callbackWCallee.getCallee());
     callbackW->setLinkage(GlobalValue::ExternalWeakLinkage);
 
+    // Create callback function for strided RW in loops
+    // Call sig: base ptr, number of accesses, stride in bytes
+    FunctionType* FunctionRangeType = FunctionType::get(Void_Type, {Int_Type, Ptr_Type, Int64_Type, Int64_Type}, false);
+    callbackRangeRCallee = M.getOrInsertFunction("PPDCV_MemRangeRCallback", FunctionRangeType, fnAttr);
+    Function* callbackRangeR = dyn_cast<Function>(callbackRangeRCallee.getCallee());
+    callbackRangeR->setLinkage(GlobalValue::ExternalWeakLinkage);
+    callbackRangeWCallee = M.getOrInsertFunction("PPDCV_MemRangeWCallback", FunctionRangeType, fnAttr);
+    Function* callbackRangeW = dyn_cast<Function>(callbackRangeWCallee.getCallee());
+    callbackRangeW->setLinkage(GlobalValue::ExternalWeakLinkage);
+
+    // Gates for memory callbacks, maintained by the runtime
+    memRGate = dyn_cast<GlobalVariable>(M.getOrInsertGlobal("PPDCV_MemRGate", Int_Type));
+    memRGate->setLinkage(GlobalValue::ExternalWeakLinkage);
+    memWGate = dyn_cast<GlobalVariable>(M.getOrInsertGlobal("PPDCV_MemWGate", Int_Type));
+    memWGate->setLinkage(GlobalValue::ExternalWeakLinkage);
+
+    // Fast paths linked into the module as bitcode are called instead of the runtime, and inlined after instrumentation.
+    // These are only linked here, so that the static analysis does not see them
+    if (!ClFastPathBitcode.empty()) linkFastPaths(M);
+    useFastPath(M, callbackRCallee, "PPDCV_MemRFastPath");
+    useFastPath(M, callbackWCallee, "PPDCV_MemWFastPath");
+    useFastPath(M, callbackRangeRCallee, "PPDCV_MemRangeRFastPath");
+    useFastPath(M, callbackRangeWCallee, "PPDCV_MemRangeWFastPath");
+    if (!fast_paths.empty()) errs() << "CoVer: Using " << fast_paths.size() << " inlinable memory callback fast paths\n";
+
     // Create callbacks
+    auto const rw_start_time = std::chrono::system_clock::now();
     if (ClInstrumentType != "funconly")
-        instrumentRW(M);
+        instrumentRW(M, AM);
+    auto const functions_start_time = std::chrono::system_clock::now();
     instrumentFunctions(M);
+    auto const end_time = std::chrono::system_clock::now();
+    finalizeImageGlobal(M, GlobalDB);
+    if (ignorelist || allowlist) {
+        int num_excluded = std::count_if(excluded_functions.begin(), excluded_functions.end(), [](auto const& entry) { return entry.second; });
+        errs() << "CoVer: Excluded " << num_excluded << " functions from instrumentation by ignorelist and allowlist\n";
+    }
+    if (!ClInstrumentReport.empty()) writeInstrumentReport(M);
+
+    std::stringstream s;
+    s << std::fixed << "CoVer: Instrumented module after " << std::chrono::duration<double>(std::chrono::system_clock::now() - start_time).count() << "s ("
+      << std::chrono::duration<double>(functions_start_time - rw_start_time).count() << "s memory accesses, "
+      << std::chrono::duration<double>(end_time - functions_start_time).count() << "s contract functions)\n";
+    errs() << s.str();
 
     return PreservedAnalyses::none();
 }
 
-Constant* InstrumentPass::createTagGlobal(Module& M) {
-    // Create Tags
-    std::vector<Constant*> tags;
-    std::vector<Constant*> funcs;
-    int count = 0;
-    for (std::pair<Function*, std::vector<TagUnit>> functags : DB->Tags) {
-        for (TagUnit tag : functags.second) {
-            Constant* param = ConstantInt::get(Int_Type, tag.param ? *tag.param : -1);
-            Constant* str = ConstantDataArray::getString(M.getContext(), tag.tag);
-            GlobalVariable* strGlobal = createConstantGlobal(M, str, "CONTR_TAG_STR_" + tag.tag);
-            Constant* TagC = ConstantStruct::get(Tag_Type, {strGlobal,param});
-            funcs.push_back(functags.first);
-            tags.push_back(TagC);
-            count++;
+void InstrumentPass::writeInstrumentReport(Module& M) {
+    // Callbacks are found in the final IR, so that all instrumentation modes and elisions are accounted for
+    enum CallbackKind { FUNCTION, MEMORY_READ, MEMORY_WRITE, NUM_KINDS };
+    static char const* const kind_names[NUM_KINDS] = {"function", "memory_read", "memory_write"};
+    DenseMap<Value const*, CallbackKind> callback_kinds = {
+        {callbackFuncCallee.getCallee(), FUNCTION}, {callbackWrapperCallee.getCallee(), FUNCTION},
+        {callbackRCallee.getCallee(), MEMORY_READ}, {callbackRangeRCallee.getCallee(), MEMORY_READ},
+        {callbackWCallee.getCallee(), MEMORY_WRITE}, {callbackRangeWCallee.getCallee(), MEMORY_WRITE},
+    };
+
+    struct FunctionReport {
+        std::string name;
+        uint64_t count[NUM_KINDS] = {};
+        uint64_t relevant = 0; // Callbacks at locations reported by the static analysis, kept for coverage
+        unsigned max_loop_depth = 0;
+        double estimated = 0; // Weighted by ClReportLoopWeight per enclosing loop, per invocation of the function
+    };
+    std::vector<FunctionReport> reports;
+    FunctionReport total;
+    total.name = "<total>";
+    for (Function& F : M) {
+        if (F.isDeclaration() || fast_paths.contains(&F)) continue;
+        std::unique_ptr<LoopInfo> LI; // Only computed for functions with callbacks
+        FunctionReport report;
+        report.name = demangle(F.getName());
+        for (Instruction const& I : instructions(F)) {
+            CallBase const* CB = dyn_cast<CallBase>(&I);
+            if (!CB) continue;
+            auto kind = callback_kinds.find(CB->getCalledOperand());
+            if (kind == callback_kinds.end()) continue;
+            if (!LI) LI = std::make_unique<LoopInfo>(DominatorTree(F));
+            unsigned const depth = LI->getLoopDepth(I.getParent());
+            report.count[kind->second]++;
+            if (isRelevant(&I)) report.relevant++;
+            report.max_loop_depth = std::max(report.max_loop_depth, depth);
+            report.estimated += std::pow((double)ClReportLoopWeight, depth);
         }
+        if (!LI) continue;
+        for (int k = 0; k < NUM_KINDS; k++) total.count[k] += report.count[k];
+        total.relevant += report.relevant;
+        total.max_loop_depth = std::max(total.max_loop_depth, report.max_loop_depth);
+        total.estimated += report.estimated;
+        reports.push_back(report);
     }
+    std::sort(reports.begin(), reports.end(), [](FunctionReport const& a, FunctionReport const& b) { return a.estimated > b.estimated; });
 
-    // Create global const arrays for the tags
-    ArrayType* ArrFuncTy = ArrayType::get(Ptr_Type, count);
-    ArrayType* ArrTagTy = ArrayType::get(Tag_Type, count);
-    GlobalVariable* ptrFuncs = createConstantGlobal(M, ConstantArray::get(ArrFuncTy, funcs), "CONTR_TAG_ARRAY_PTRS");
-    GlobalVariable* ptrTags = createConstantGlobal(M, ConstantArray::get(ArrTagTy, tags), "CONTR_TAG_ARRAY_TAGS");
+    auto toJson = [](FunctionReport const& report) {
+        Json::Value j;
+        j["function"] = report.name;
+        for (int k = 0; k < NUM_KINDS; k++) j[kind_names[k]] = (Json::UInt64)report.count[k];
+        j["coverage_relevant"] = (Json::UInt64)report.relevant;
+        j["max_loop_depth"] = report.max_loop_depth;
+        j["estimated_dynamic"] = report.estimated;
+        return j;
+    };
+    Json::Value json;
+    json["instrument_type"] = ClInstrumentType.getValue();
+    json["loop_weight"] = ClReportLoopWeight.getValue();
+    json["total"] = toJson(total);
+    json["functions"] = Json::arrayValue;
+    for (FunctionReport const& report : reports) json["functions"].append(toJson(report));
+    std::ofstream file(ClInstrumentReport);
+    if (!file) {
+        WithColor(errs(), HighlightColor::Error) << "Could not write instrumentation report to " << ClInstrumentReport << "!\n";
+        exit(EXIT_FAILURE);
+    }
+    file << Json::FastWriter().write(json);
+
+    // Text summary of the most expensive functions
+    errs() << "CoVer: Instrumentation report (loop weight " << ClReportLoopWeight << ", written to " << ClInstrumentReport << ")\n";
+    errs() << "  Function                                   Function       Read      Write   Relevant   Est. dynamic\n";
+    auto printRow = [](FunctionReport const& report) {
+        std::string name = report.name.size() > 40 ? report.name.substr(0, 37) + "..." : report.name;
+        errs() << format("  %-40s %10llu %10llu %10llu %10llu %14.0f\n", name.c_str(), (unsigned long long)report.count[FUNCTION], (unsigned long long)report.count[MEMORY_READ],
+                         (unsigned long long)report.count[MEMORY_WRITE], (unsigned long long)report.relevant, report.estimated);
+    };
+    for (size_t i = 0; i < std::min<size_t>(reports.size(), 10); i++) printRow(reports[i]);
+    if (reports.size() > 10) errs() << "  ... " << reports.size() - 10 << " more functions\n";
+    printRow(total);
+}
+
+uint32_t InstrumentPass::getStringOffset(StringRef str) {
+    auto it = db_string_offsets.find(str);
+    if (it != db_string_offsets.end()) return it->second;
+    uint32_t offset = db_strings.size();
+    db_strings.append(str.begin(), str.end());
+    db_strings.push_back('\0');
+    db_string_offsets[str] = offset;
+    return offset;
+}
+
+uint32_t InstrumentPass::getFunctionIndex(Function* F) {
+    auto it = db_function_ids.find(F);
+    if (it != db_function_ids.end()) return it->second;
+    db_function_ids[F] = db_functions.size();
+    db_functions.push_back(F);
+    return db_functions.size() - 1;
+}
 
-    // Full tag map structure
-    Constant* TagsStruct = ConstantStruct::get(Tags_Type, {ptrFuncs, ptrTags, ConstantInt::get(Int_Type, count)});
-    return TagsStruct;
+void InstrumentPass::encodeTags(DBHeader_t& header) {
+    std::vector<DBTag_t> tags;
+    for (std::pair<Function* const, std::vector<TagUnit>> const& functags : DB->Tags) {
+        for (TagUnit const& tag : functags.second) {
+            tags.push_back({getFunctionIndex(functags.first), getStringOffset(tag.tag), tag.param ? *tag.param : -1});
+        }
+    }
+    header.tags = appendRecords(tags);
+    header.num_tags = tags.size();
 }
 
-std::pair<Constant*, int64_t> InstrumentPass::createReferencesGlobal(Module &M) {
-    std::vector<Constant*> crefs;
+void InstrumentPass::encodeReferences(DBHeader_t& header) {
+    std::vector<DBReference_t> refs;
     for (ErrorMessage const& msg : err_msgs) {
-        GlobalVariable* emsg = createConstantGlobal(M, ConstantDataArray::getString(M.getContext(), msg.type), "CONTR_ERROR_TYPE_" + msg.type);
         for (FileReference const& ref : msg.references) {
-            std::string reference_str = ref.file + ":" + std::to_string(ref.line);
-            GlobalVariable* fref = createConstantGlobal(M, ConstantDataArray::getString(M.getContext(), reference_str), "CONTR_REFERENCE_" + reference_str);
-            crefs.push_back(ConstantStruct::get(Ref_Type, {fref, emsg}));
+            refs.push_back({getStringOffset(ref.file + ":" + std::to_string(ref.line)), getStringOffset(msg.type), reference_counters.at(ref)});
         }
     }
-    ArrayType* ArrRefs = ArrayType::get(Ref_Type, crefs.size());
-    GlobalVariable* arrRefsGlobal = createConstantGlobal(M, ConstantArray::get(ArrRefs, crefs), "CONTR_LIST_REFERENCES");
-    return {arrRefsGlobal, crefs.size()};
+    header.references = appendRecords(refs);
+    header.num_references = refs.size();
+}
+
+int InstrumentPass::countOperations(std::vector<std::shared_ptr<ContractFormula>> const& forms) {
+    int count = 0;
+    for (std::shared_ptr<ContractFormula> const& form : forms)
+        count += form->Children.empty() ? 1 : countOperations(form->Children);
+    return count;
+}
+
+std::vector<std::shared_ptr<ContractFormula>> InstrumentPass::getRuntimeFormulas(std::vector<std::shared_ptr<ContractFormula>> const& forms, FormulaType connective) {
+    // Statically fulfilled conjuncts need no runtime analysis. Disjunctions and XOR depend on all of their children
+    if (!ClPruneFulfilled || connective != FormulaType::AND) return forms;
+    std::vector<std::shared_ptr<ContractFormula>> remaining;
+    for (std::shared_ptr<ContractFormula> const& form : forms)
+        if (*form->Status != Fulfillment::FULFILLED) remaining.push_back(form);
+    return remaining;
 }
 
-std::pair<Constant*, int64_t> InstrumentPass::createContractsGlobal(Module& M) {
-    std::vector<Constant*> contractConsts;
-    for (ContractManagerAnalysis::Contract C : DB->Contracts) {
+void InstrumentPass::encodeContracts(Module& M, DBHeader_t& header) {
+    std::vector<DBContract_t> contracts;
+    int num_pruned_ops = 0;
+    int num_pruned_contracts = 0;
+    for (ContractManagerAnalysis::Contract const& C : DB->Contracts) {
+        uint32_t function = getFunctionIndex(C.F); // Instrumented even without scopes, so needs a gate
         if (C.Data.Pre.empty() && C.Data.Post.empty()) continue;
-        Constant* PrecondConst = createScopeGlobal(M, C.Data.Pre);
-        Constant* PostcondConst = createScopeGlobal(M, C.Data.Post);
-        GlobalVariable* strGlobal = createConstantGlobal(M, ConstantDataArray::getString(M.getContext(), C.F->getName()), "CONTR_FUNC_STR_" + C.F->getName().str());
-        Constant* contr = ConstantStruct::get(Contract_Type, {PrecondConst, PostcondConst, C.F, strGlobal});
-        contractConsts.push_back(contr);
+        std::vector<std::shared_ptr<ContractFormula>> pre_forms = getRuntimeFormulas(C.Data.Pre, FormulaType::AND);
+        std::vector<std::shared_ptr<ContractFormula>> post_forms = getRuntimeFormulas(C.Data.Post, FormulaType::AND);
+        num_pruned_ops += countOperations(C.Data.Pre) + countOperations(C.Data.Post);
+        if (pre_forms.empty() && post_forms.empty()) {
+            num_pruned_contracts++;
+            continue;
+        }
+        encoding_supplier = C.F;
+        uint32_t pre = encodeScope(M, pre_forms);
+        uint32_t post = encodeScope(M, post_forms);
+        num_pruned_ops -= countEncodedOperations(C.Data.Pre, FormulaType::AND) + countEncodedOperations(C.Data.Post, FormulaType::AND);
+        contracts.push_back({pre, post, function, getStringOffset(C.F->getName())});
+        runtime_suppliers.insert(C.F);
     }
+    header.contracts = appendRecords(contracts);
+    header.num_contracts = contracts.size();
+    if (ClPruneFulfilled)
+        errs() << "CoVer: Avoided " << num_pruned_ops << " runtime analyses for statically fulfilled formulas (" << num_pruned_contracts << " contracts fully fulfilled)\n";
+}
 
-    // Create list of contracts
-    ArrayType* ArrContracts = ArrayType::get(Contract_Type, contractConsts.size());
-    GlobalVariable* arrContractGlobal = createConstantGlobal(M,  ConstantArray::get(ArrContracts, contractConsts), "CONTR_LIST_CONTRACTS");
+int InstrumentPass::countEncodedOperations(std::vector<std::shared_ptr<ContractFormula>> const& forms, FormulaType connective) {
+    int count = 0;
+    for (std::shared_ptr<ContractFormula> const& form : getRuntimeFormulas(forms, connective))
+        count += form->Children.empty() ? 1 : countEncodedOperations(form->Children, form->type);
+    return count;
+}
 
-    return {arrContractGlobal, contractConsts.size()};
+uint32_t InstrumentPass::encodeScope(Module& M, std::vector<std::shared_ptr<ContractFormula>> const& forms) {
+    if (forms.empty()) return COVER_DB_NONE;
+    uint32_t children = encodeFormulas(M, forms);
+    return appendRecord(DBFormula_t{children, (uint32_t)forms.size(), (int32_t)FormulaType::AND, getStringOffset("Full Scope"), COVER_DB_NONE, -1});
 }
 
-Constant* InstrumentPass::createScopeGlobal(Module& M, std::vector<std::shared_ptr<ContractFormula>> forms) {
-    std::vector<Constant*> formsConst;
-    static Constant* scopeMsgConst = createConstantGlobal(M, ConstantDataArray::getString(M.getContext(), "Full Scope"), "CONTR_SCOPE_STR_");
-    if (forms.empty()) return Null_Const;
-    for (std::shared_ptr<ContractFormula> form : forms) {
-        formsConst.push_back(createFormulaGlobal(M, form));
+uint32_t InstrumentPass::encodeFormulas(Module& M, std::vector<std::shared_ptr<ContractFormula>> const& forms) {
+    // Siblings are contiguous, their operations and children follow
+    uint32_t offset = reserveRecords<DBFormula_t>(forms.size());
+    for (size_t i = 0; i < forms.size(); i++) {
+        writeRecord(offset + i * sizeof(DBFormula_t), encodeFormula(M, forms[i]));
     }
-    ArrayType* ArrPreCond = ArrayType::get(Formula_Type, forms.size());
-    GlobalVariable* Sublevel = createConstantGlobalUnique(M, ConstantArray::get(ArrPreCond, formsConst), std::string("CONTR_SCOPECONDITIONS"));
-    return createConstantGlobalUnique(M, ConstantStruct::get(Formula_Type, { Sublevel, ConstantInt::get(Int_Type, forms.size()), ConstantInt::get(Int_Type, (int64_t)FormulaType::AND), scopeMsgConst, Null_Const}), "CONTR_SCOPE");
+    return offset;
 }
 
-Constant* InstrumentPass::createFormulaGlobal(Module& M, std::shared_ptr<ContractFormula> form) {
-    Constant* op_const = Null_Const;
-    Constant* children = Null_Const;
-    Constant* msg = Null_Const;
+DBFormula_t InstrumentPass::encodeFormula(Module& M, std::shared_ptr<ContractFormula> const& form) {
     std::string descriptor = form->Message ? form->Message->text : form->ExprStr;
-    msg = createConstantGlobal(M, ConstantDataArray::getString(M.getContext(), descriptor), "CONTR_MSG_" + descriptor);
-    int64_t connective;
     if (form->Children.empty()) {
         // Expression
         std::shared_ptr<const Operation> OP = static_pointer_cast<ContractExpression>(form)->OP;
-        op_const = createOperationGlobal(M, OP);
-        connective = (int64_t)OP->type();
-    } else {
-        connective = (int64_t)form->type;
-        std::vector<Constant*> childConsts;
-        for (std::shared_ptr<ContractFormula> child : form->Children) {
-            childConsts.push_back(createFormulaGlobal(M, child));
-        }
-        ArrayType* ArrChildren = ArrayType::get(Formula_Type, childConsts.size());
-        children = createConstantGlobalUnique(M, ConstantArray::get(ArrChildren, childConsts), "CONTRACT_CHILDREN");
+        return {COVER_DB_NONE, 0, (int32_t)OP->type(), getStringOffset(descriptor), encodeOperation(M, OP), getVerdictBit(form)};
     }
-    return ConstantStruct::get(Formula_Type, {children, ConstantInt::get(Int_Type, form->Children.size()), ConstantInt::get(Int_Type, connective), msg, op_const});
+    std::vector<std::shared_ptr<ContractFormula>> children = getRuntimeFormulas(form->Children, form->type);
+    return {encodeFormulas(M, children), (uint32_t)children.size(), (int32_t)form->type, getStringOffset(descriptor), COVER_DB_NONE, -1};
+}
+
+int32_t InstrumentPass::getVerdictBit(std::shared_ptr<ContractFormula> const& form) {
+    // Bits are numbered per supplier, as the mask is passed by its callsites
+    std::vector<std::shared_ptr<std::set<CallBase const*>>>& bits = verdict_bits[encoding_supplier];
+    if (!ClStaticVerdicts || form->SafeCallsites->empty() || bits.size() >= 64) return -1;
+    bits.push_back(form->SafeCallsites);
+    return bits.size() - 1;
 }
 
-Constant* InstrumentPass::createOperationGlobal(Module& M, std::shared_ptr<const Operation> op) {
-    Constant* data = Null_Const;
-    std::string name;
+uint32_t InstrumentPass::encodeOperation(Module& M, std::shared_ptr<const Operation> const& op) {
     switch (op->type()) {
         case OperationType::READ:
         case OperationType::WRITE: {
             std::shared_ptr<const RWOperation> rwOP = static_pointer_cast<const RWOperation>(op);
-            Constant* isWrite = ConstantInt::getBool(Bool_Type, op->type() == OperationType::WRITE);
-            ConstantInt* const_paramacc = ConstantInt::get(Int_Type, (int)rwOP->contrParamAccess);
-            ConstantInt* const_idx = ConstantInt::get(Int_Type, (int)rwOP->contrP);
-            data = ConstantStruct::get(RWOp_Type, {const_idx, const_paramacc, isWrite});
-            name = "CONTR_RWOP";
-            break;
+            return appendRecord(DBRWOp_t{rwOP->contrP, (int32_t)rwOP->contrParamAccess, op->type() == OperationType::WRITE});
         }
         case OperationType::CALL: {
             std::shared_ptr<const CallOperation> cOP = static_pointer_cast<const CallOperation>(op);
             Function* F = M.getFunction(cOP->Function) ? M.getFunction(cOP->Function) : M.getFunction(StringRef(cOP->Function).lower() + "_");
             if (!F) WithColor::warning() << "Specified function \"" << cOP->Function << "\" in calloperation does not exist or unused in module. This may cause issues for instrumentation.\n";
             else mentioned_funcs.push_back(F);
-            Constant* funcStr = ConstantDataArray::getString(M.getContext(), cOP->Function);
-            std::pair<Constant*,int64_t> paramGlobal = createParamList(M, cOP->Params);
-            data = ConstantStruct::get(CallOp_Type, {createConstantGlobal(M, funcStr, "CONTR_FUNC_STR_" + cOP->Function), paramGlobal.first, ConstantInt::get(Int_Type, paramGlobal.second), F ? F : Null_Const});
-            name = "CONTR_CALLOP";
-            break;
+            std::pair<uint32_t, uint32_t> params = encodeParamList(cOP->Params);
+            return appendRecord(DBCallOp_t{getStringOffset(cOP->Function), params.first, params.second, F ? getFunctionIndex(F) : COVER_DB_NONE});
         }
         case OperationType::CALLTAG: {
             std::shared_ptr<const CallOperation> cOP = static_pointer_cast<const CallOperation>(op);
-            data = createConstantGlobal(M, ConstantDataArray::getString(M.getContext(), cOP->Function), "CONTR_TAG_STR_" + cOP->Function);
-            std::pair<Constant*,int64_t> paramGlobal = createParamList(M, cOP->Params);
-            data = ConstantStruct::get(CallTagOp_Type, {data, paramGlobal.first, ConstantInt::get(Int_Type, paramGlobal.second)});
-            name = "CONTR_CALLTAGOP";
-            break;
+            std::pair<uint32_t, uint32_t> params = encodeParamList(cOP->Params);
+            mentioned_tags.insert(cOP->Function);
+            return appendRecord(DBCallTagOp_t{getStringOffset(cOP->Function), params.first, params.second});
         }
-        case OperationType::RELEASE:
+        case OperationType::RELEASE: {
             std::shared_ptr<const ReleaseOperation> rOP = static_pointer_cast<const ReleaseOperation>(op);
-            Constant* forbidden_op = createOperationGlobal(M, rOP->Forbidden);
-            Constant* forb_type = ConstantInt::get(Int_Type, (int64_t)rOP->Forbidden->type());
-            Constant* release_op = createOperationGlobal(M, rOP->Until);
-            Constant* release_type = ConstantInt::get(Int_Type, (int64_t)rOP->Until->type());
-            data = ConstantStruct::get(ReleaseOp_Type, {release_op, release_type, forbidden_op, forb_type});
-            name = "CONTR_RELEASE";
-            break;
+            uint32_t forbidden_op = encodeOperation(M, rOP->Forbidden);
+            uint32_t release_op = encodeOperation(M, rOP->Until);
+            return appendRecord(DBReleaseOp_t{release_op, (int32_t)rOP->Until->type(), forbidden_op, (int32_t)rOP->Forbidden->type()});
+        }
     }
-    return createConstantGlobalUnique(M, data, name);
+    llvm_unreachable("Unknown operation type");
 }
 
-GlobalVariable* InstrumentPass::createConstantGlobalUnique(Module& M, Constant* C, std::string name) {
-    static uint64_t globals_counter = 0; // For name uniqueness
-    return createConstantGlobal(M, C, name + "_" + std::to_string(globals_counter++));
+std::pair<uint32_t, uint32_t> InstrumentPass::encodeParamList(std::vector<CallParam> const& params) {
+    if (params.empty()) return {COVER_DB_NONE, 0};
+    std::vector<DBCallParam_t> encoded;
+    for (CallParam const& param : params) {
+        encoded.push_back({param.callP, param.callPisTagVar, param.contrP, (int32_t)param.contrParamAccess});
+    }
+    return {appendRecords(encoded), encoded.size()};
 }
 
+GlobalVariable* InstrumentPass::createImageGlobal(Module& M) {
+    DBHeader_t header = {COVER_DB_MAGIC, COVER_DB_VERSION};
+    db_blob.resize(sizeof(DBHeader_t));
+    encodeTags(header);
+    encodeReferences(header);
+    encodeContracts(M, header);
+    header.strings = db_blob.size();
+    header.strings_size = db_strings.size();
+    db_blob += db_strings;
+    writeRecord(0, header);
+
+    // Only the function table and the image itself need relocations
+    GlobalVariable* blobGlobal = createConstantGlobal(M, ConstantDataArray::getString(M.getContext(), db_blob, false), "CONTR_DB_BLOB");
+    blobGlobal->setAlignment(Align(alignof(DBHeader_t)));
+    std::vector<Constant*> functions(db_functions.begin(), db_functions.end());
+    GlobalVariable* functionsGlobal = createConstantGlobal(M, ConstantArray::get(ArrayType::get(Ptr_Type, functions.size()), functions), "CONTR_DB_FUNCTIONS");
+    // Open until the runtime initializes the gates
+    ArrayType* Gates_Type = ArrayType::get(Int_Type, functions.size());
+    gatesGlobal = new GlobalVariable(M, Gates_Type, false, GlobalValue::InternalLinkage, ConstantArray::get(Gates_Type, std::vector<Constant*>(functions.size(), ConstantInt::get(Int_Type, 1))), "CONTR_GATES");
+    // Hit count of each relevant reference location, incremented inline at the instrumented instructions
+    ArrayType* Counters_Type = ArrayType::get(Int8_Type, reference_counters.size());
+    countersGlobal = new GlobalVariable(M, Counters_Type, false, GlobalValue::InternalLinkage, ConstantAggregateZero::get(Counters_Type), "CONTR_COVERAGE");
+
+    errs() << "CoVer: Contract database image has " << db_blob.size() << " bytes and " << functions.size() << " function references\n";
+    image_fields = {blobGlobal, ConstantInt::get(Int_Type, db_blob.size()), functionsGlobal, gatesGlobal, ConstantInt::get(Int_Type, functions.size()), countersGlobal, ConstantInt::get(Int_Type, reference_counters.size())};
+    // Site table is added once all callbacks are inserted, see finalizeImageGlobal
+    num_calls.assign(functions.size(), 0);
+    return createConstantGlobal(M, ConstantStruct::get(Image_Type, {image_fields[0], image_fields[1], image_fields[2], image_fields[3], image_fields[4], image_fields[5], image_fields[6], ConstantPointerNull::get(Ptr_Type), ConstantInt::get(Int_Type, 0), ConstantPointerNull::get(Ptr_Type)}), "CONTR_DB");
+}
+
+void InstrumentPass::finalizeImageGlobal(Module& M, GlobalVariable* image) {
+    // Site records first, followed by the file names they reference
+    std::string sites_blob(sites.size() * sizeof(DBSite_t), '\0');
+    for (DBSite_t& site : sites)
+        if (site.file != COVER_DB_NONE) site.file += sites_blob.size();
+    memcpy(sites_blob.data(), sites.data(), sites_blob.size());
+    sites_blob += site_files;
+    GlobalVariable* sitesGlobal = createConstantGlobal(M, ConstantDataArray::getString(M.getContext(), sites_blob, false), "CONTR_DB_SITES");
+    sitesGlobal->setAlignment(Align(alignof(DBSite_t)));
+    GlobalVariable* callsGlobal = createConstantGlobal(M, ConstantDataArray::get(M.getContext(), num_calls), "CONTR_DB_CALLS");
+    image->setInitializer(ConstantStruct::get(Image_Type, {image_fields[0], image_fields[1], image_fields[2], image_fields[3], image_fields[4], image_fields[5], image_fields[6], sitesGlobal, ConstantInt::get(Int_Type, sites.size()), callsGlobal}));
+    errs() << "CoVer: Location table has " << sites.size() << " instrumented sites\n";
+}
+
+uint32_t InstrumentPass::getSiteId(Instruction const* I) {
+    DBSite_t site = {COVER_DB_NONE, 0, 0};
+    if (I->getDebugLoc()) {
+        LocationKey loc = getLocationKey(I);
+        auto it = site_file_offsets.find(std::get<0>(loc));
+        if (it == site_file_offsets.end()) {
+            it = site_file_offsets.insert({std::get<0>(loc), (uint32_t)site_files.size()}).first;
+            site_files.append(file_names[std::get<0>(loc)]);
+            site_files.push_back('\0');
+        }
+        site = {it->second, std::get<1>(loc), std::get<2>(loc)};
+    }
+    sites.push_back(site);
+    return sites.size() - 1;
+}
 
 GlobalVariable* InstrumentPass::createConstantGlobal(Module& M, Constant* C, std::string name) {
-    GlobalVariable* GV = dyn_cast<GlobalVariable>(M.getOrInsertGlobal(name, C->getType()));
-    GV->setInitializer(C);
+    GlobalVariable* GV = new GlobalVariable(M, C->getType(), true, GlobalValue::PrivateLinkage, C, name);
+    GV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
     return GV;
 }
 
+void InstrumentPass::linkFastPaths(Module& M) {
+    SMDiagnostic err;
+    std::unique_ptr<Module> fast_module = parseIRFile(ClFastPathBitcode, err, M.getContext());
+    if (!fast_module || Linker::linkModules(M, std::move(fast_module))) {
+        WithColor::warning() << "Could not link fast paths from \"" << ClFastPathBitcode << "\", calling the runtime directly instead\n";
+        if (!fast_module) err.print("CoVer", errs());
+    }
+    // The fast paths declare the runtime symbols they use as plain externals. Weak like the other runtime symbols, as shared libraries leave them undefined
+    for (GlobalValue& GV : M.global_values())
+        if (GV.isDeclaration() && GV.getName().starts_with("PPDCV_")) GV.setLinkage(GlobalValue::ExternalWeakLinkage);
+}
+
+void InstrumentPass::useFastPath(Module& M, FunctionCallee& callback, StringRef name) {
+    Function* fast = M.getFunction(name);
+    if (!fast || fast->isDeclaration() || fast->getFunctionType() != callback.getFunctionType()) return;
+    // Not needed once inlined
+    fast->setLinkage(GlobalValue::InternalLinkage);
+    fast->removeFnAttr(Attribute::NoInline);
+    fast->addFnAttr(Attribute::AlwaysInline);
+    callback = fast;
+    fast_paths.insert(fast);
+}
+
 void InstrumentPass::createTypes(Module& M) {
     // Basic Types
     Ptr_Type = PointerType::get(M.getContext(), 0);
     Int_Type = IntegerType::get(M.getContext(), 32);
-    Bool_Type = IntegerType::get(M.getContext(), 1);
-    Null_Const = ConstantPointerNull::getNullValue(Ptr_Type);
+    Int64_Type = IntegerType::get(M.getContext(), 64);
+    Int8_Type = IntegerType::get(M.getContext(), 8);
     Void_Type = Type::getVoidTy(M.getContext());
 
-    // Operations
-    Param_Type = StructType::create(M.getContext(), "CallParam_t");
-    Param_Type->setBody({Int_Type, Bool_Type, Int_Type, Int_Type}); // call param, bool param is tag ref, contr param, acc type
-
-    CallOp_Type = StructType::create(M.getContext(), "CallOp_t");
-    CallOp_Type->setBody({Ptr_Type, Ptr_Type, Int_Type, Ptr_Type}); // char* Function Name, list of params, num of params, Function Pointer
-
-    CallTagOp_Type = StructType::create(M.getContext(), "CallTagOp_t");
-    CallTagOp_Type->setBody({Ptr_Type, Ptr_Type, Int_Type}); // char* Tag name, list of params, num of params
+    // Passed to the runtime
+    Image_Type = StructType::create(M.getContext(), "ContractDBImage_t");
+    Image_Type->setBody({Ptr_Type, Int_Type, Ptr_Type, Ptr_Type, Int_Type, Ptr_Type, Int_Type, Ptr_Type, Int_Type, Ptr_Type}); // blob, blob size, function table, gate array, num functions, coverage counters, num counters, site table, num sites, calls per function
+}
 
-    ReleaseOp_Type = StructType::create(M.getContext(), "ReleaseOp_t");
-    ReleaseOp_Type->setBody({Ptr_Type, Int_Type, Ptr_Type, Int_Type}); // void* release op, relop type, void* forbidden op, forbop type
+void InstrumentPass::instrumentFunctions(Module &M) {
+    // Only parameters referenced by some contract are passed to the runtime
+    for (ContractManagerAnalysis::Contract const& C : DB->Contracts) {
+        collectUsedParams(M, C.Data.Pre, C.F);
+        collectUsedParams(M, C.Data.Post, C.F);
+    }
 
-    RWOp_Type = StructType::create(M.getContext(), "RWOp_t");
-    RWOp_Type->setBody({Int_Type, Int_Type, Bool_Type}); // idx, paramaccess, isWrite
+    // All functions with contracts checked at runtime
+    int num_skipped = 0;
+    for (ContractManagerAnalysis::Contract const& C : DB->Contracts) {
+        if (runtime_suppliers.contains(C.F) || hasRelevantCallsite(C.F)) insertFunctionInstrCallback(C.F);
+        else num_skipped++;
+    }
 
-    // Composite Types
-    Tag_Type = StructType::create(M.getContext(), "Tag_t");
-    Tag_Type->setBody({Ptr_Type, Int_Type}); // tag str, param num
+    // All functions referenced in tags used at runtime
+    for (std::pair<Function* const, std::vector<TagUnit>> const& tag : DB->Tags) {
+        bool used = hasRelevantCallsite(tag.first);
+        for (TagUnit const& unit : tag.second) used |= mentioned_tags.contains(unit.tag);
+        if (used) insertFunctionInstrCallback(tag.first);
+        else num_skipped++;
+    }
 
-    Formula_Type = StructType::create(M.getContext(), "ContractFormula_t");
-    Formula_Type->setBody({Ptr_Type, Int_Type, Int_Type, Ptr_Type, Ptr_Type}); // Children, number of children, connective, message char*, expression data ptr
+    // All functions referenced by name
+    for (Function* F : mentioned_funcs) {
+        insertFunctionInstrCallback(F);
+    }
 
-    Contract_Type = StructType::create(M.getContext(), "Contract_t");
-    Contract_Type->setBody({Ptr_Type, Ptr_Type, Ptr_Type, Ptr_Type}); // Precondition ptr, Postcondition ptr, contr supplier ptr, supplier name
+    if (ClPruneFulfilled)
+        errs() << "CoVer: Skipped callbacks for " << num_skipped << " contract suppliers and tagged functions not needed at runtime\n";
+    if (ClStaticVerdicts)
+        errs() << "CoVer: Passed static verdicts for " << num_proven_callsites << " supplier callsites\n";
+    if (!ClInstrumentWrappers.empty())
+        errs() << "CoVer: Instrumented " << num_wrapped << " functions through wrappers, " << num_interposed << " of them interposed\n";
+}
 
-    Tags_Type = StructType::create(M.getContext(), "TagsMap_t");
-    Tags_Type->setBody({Ptr_Type, Ptr_Type, Int_Type}); // Funcptr list, Tag + param struct list, num elems
+bool InstrumentPass::hasRelevantCallsite(Function const* F) {
+    for (User const* U : F->users())
+        if (isa<CallBase>(U) && isRelevant(cast<Instruction>(U))) return true;
+    return false;
+}
 
-    Ref_Type = StructType::create(M.getContext(), "Reference_t");
-    Ref_Type->setBody({Ptr_Type, Ptr_Type}); // char* file ref, char* type
+void InstrumentPass::collectWatchedParams(std::vector<std::shared_ptr<ContractFormula>> const& forms, Function* supplier) {
+    for (std::shared_ptr<ContractFormula> const& form : forms) {
+        collectWatchedParams(getRuntimeFormulas(form->Children, form->type), supplier);
+        if (!form->Children.empty()) continue;
+        std::shared_ptr<const Operation> OP = static_pointer_cast<ContractExpression>(form)->OP;
+        if (OP->type() != OperationType::RELEASE) continue;
+        std::shared_ptr<const Operation> forbidden = static_pointer_cast<const ReleaseOperation>(OP)->Forbidden;
+        if (forbidden->type() != OperationType::READ && forbidden->type() != OperationType::WRITE) continue;
+        watched_params.insert({supplier, static_pointer_cast<const RWOperation>(forbidden)->contrP});
+        if (forbidden->type() == OperationType::READ) has_watched_reads = true;
+        else has_watched_writes = true;
+    }
+}
 
-    DB_Type = StructType::create(M.getContext(), "ContractDB_t");
-    DB_Type->setBody({Ptr_Type, Int_Type, Tags_Type, Ptr_Type, Int_Type}); // contract list, num elems, tag container, reference list, num refs
+void InstrumentPass::collectUsedParams(Module& M, std::vector<std::shared_ptr<ContractFormula>> const& forms, Function* supplier) {
+    for (std::shared_ptr<ContractFormula> const& form : forms) {
+        collectUsedParams(M, form->Children, supplier);
+        if (form->Children.empty()) collectUsedParams(M, static_pointer_cast<ContractExpression>(form)->OP, supplier);
+    }
 }
 
-void InstrumentPass::instrumentFunctions(Module &M) {
-    // All functions with attached contracts
-    for (ContractManagerAnalysis::Contract C : DB->Contracts) {
-        insertFunctionInstrCallback(C.F);
+void InstrumentPass::collectUsedParams(Module& M, std::shared_ptr<const Operation> const& op, Function* supplier) {
+    switch (op->type()) {
+        case OperationType::READ:
+        case OperationType::WRITE:
+            used_params[supplier].insert(static_pointer_cast<const RWOperation>(op)->contrP);
+            break;
+        case OperationType::CALL: {
+            std::shared_ptr<const CallOperation> cOP = static_pointer_cast<const CallOperation>(op);
+            Function* F = M.getFunction(cOP->Function) ? M.getFunction(cOP->Function) : M.getFunction(StringRef(cOP->Function).lower() + "_");
+            for (CallParam const& param : cOP->Params) {
+                used_params[supplier].insert(param.contrP);
+                if (F && !param.callPisTagVar) used_params[F].insert(param.callP);
+            }
+            break;
+        }
+        case OperationType::CALLTAG: {
+            std::shared_ptr<const CallOperation> cOP = static_pointer_cast<const CallOperation>(op);
+            for (CallParam const& param : cOP->Params) {
+                used_params[supplier].insert(param.contrP);
+                for (std::pair<Function* const, std::vector<TagUnit>> const& functags : DB->Tags) {
+                    for (TagUnit const& tag : functags.second) {
+                        if (tag.tag != cOP->Function) continue;
+                        if (!param.callPisTagVar) used_params[functags.first].insert(param.callP);
+                        else if (tag.param) used_params[functags.first].insert(*tag.param);
+                    }
+                }
+            }
+            break;
+        }
+        case OperationType::RELEASE: {
+            std::shared_ptr<const ReleaseOperation> rOP = static_pointer_cast<const ReleaseOperation>(op);
+            collectUsedParams(M, rOP->Forbidden, supplier);
+            collectUsedParams(M, rOP->Until, supplier);
+            break;
+        }
     }
+}
 
-    // All functions referenced in tags
-    for (std::pair<Function*, std::vector<TagUnit>> tag : DB->Tags) {
-        insertFunctionInstrCallback(tag.first);
+void InstrumentPass::collectWatchedObjects() {
+    for (std::pair<Function*, int> const& param : watched_params) {
+        for (User* U : param.first->users()) {
+            CallBase* CB = dyn_cast<CallBase>(U);
+            if (!CB || param.second >= CB->arg_size()) continue;
+            watched_objects.insert(getUnderlyingObject(CB->getArgOperand(param.second)));
+        }
     }
+}
 
-    // All functions referenced by name
-    for (Function* F : mentioned_funcs) {
-        insertFunctionInstrCallback(F);
+bool InstrumentPass::mayAccessWatched(Value const* Ptr) {
+    // Watched buffers are passed to a supplier, so they are captured unless passed directly.
+    // Accesses to function-local or module-internal objects that are never captured cannot alias them.
+    Value const* Obj = getUnderlyingObject(Ptr);
+    auto cached = object_may_be_watched.find(Obj);
+    if (cached != object_may_be_watched.end()) return cached->second;
+
+    bool isLocalObject = isa<AllocaInst>(Obj) || isNoAliasCall(Obj);
+    if (GlobalVariable const* GV = dyn_cast<GlobalVariable>(Obj)) isLocalObject = GV->hasLocalLinkage();
+    bool result = watched_objects.contains(Obj) || !isLocalObject || PointerMayBeCaptured(Obj, true);
+    object_may_be_watched[Obj] = result;
+    return result;
+}
+
+bool InstrumentPass::loopHasCalls(Loop const* L) {
+    auto cached = loop_has_calls.find(L);
+    if (cached != loop_has_calls.end()) return cached->second;
+    bool result = false;
+    for (BasicBlock const* BB : L->blocks()) {
+        for (Instruction const& I : *BB) {
+            CallBase const* CB = dyn_cast<CallBase>(&I);
+            if (!CB || isa<DbgInfoIntrinsic>(CB) || CB->isLifetimeStartOrEnd()) continue;
+            // Memory callbacks inserted for other accesses in the loop do not change the watched buffers
+            if (CB->getCalledOperand() == callbackRCallee.getCallee() || CB->getCalledOperand() == callbackWCallee.getCallee()) continue;
+            result = true;
+        }
     }
+    loop_has_calls[L] = result;
+    return result;
+}
+
+bool InstrumentPass::hoistLoopAccess(Instruction* I, Value* Ptr, LoopInfo& LI, ScalarEvolution& SE, DominatorTree& DT, SCEVExpander& Expander) {
+    // Every iteration must perform the access, and no call may change the watched buffers during the loop
+    Loop* L = LI.getLoopFor(I->getParent());
+    if (!L || !L->isInnermost() || !L->getLoopPreheader() || !L->getLoopLatch()) return false;
+    if (L->getExitingBlock() != L->getLoopLatch() || !DT.dominates(I->getParent(), L->getLoopLatch())) return false;
+    if (loopHasCalls(L)) return false;
+
+    SCEVAddRecExpr const* AR = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(Ptr));
+    if (!AR || AR->getLoop() != L || !AR->isAffine()) return false;
+    SCEVConstant const* Stride = dyn_cast<SCEVConstant>(AR->getStepRecurrence(SE));
+    SCEV const* BTC = SE.getBackedgeTakenCount(L);
+    if (!Stride || isa<SCEVCouldNotCompute>(BTC)) return false;
+    SCEV const* Count = SE.getAddExpr(SE.getTruncateOrZeroExtend(BTC, Int64_Type), SE.getOne(Int64_Type));
+
+    Instruction* InsertPt = L->getLoopPreheader()->getTerminator();
+    if (!Expander.isSafeToExpandAt(AR->getStart(), InsertPt) || !Expander.isSafeToExpandAt(Count, InsertPt)) return false;
+    Value* Base = Expander.expandCodeFor(AR->getStart(), Ptr_Type, InsertPt);
+    Value* NumAccesses = Expander.expandCodeFor(Count, Int64_Type, InsertPt);
+
+    FunctionCallee FC = isa<LoadInst>(I) ? callbackRangeRCallee : callbackRangeWCallee;
+    CallInst* callbackCI = CallInst::Create(FC, {ConstantInt::get(Int_Type, getSiteId(I)), Base, NumAccesses, ConstantInt::get(Int64_Type, Stride->getAPInt().getSExtValue())});
+    callbackCI->setDebugLoc(I->getDebugLoc());
+    callbackCI->insertBefore(InsertPt->getIterator());
+    range_callbacks.push_back({callbackCI, isa<LoadInst>(I) ? memRGate : memWGate}); // Gated once all loops are analysed
+    return true;
 }
 
-void InstrumentPass::instrumentRW(Module &M) {
+void InstrumentPass::instrumentRW(Module &M, ModuleAnalysisManager &AM) {
+    for (ContractManagerAnalysis::Contract const& C : DB->Contracts) {
+        collectWatchedParams(getRuntimeFormulas(C.Data.Pre, FormulaType::AND), C.F);
+        collectWatchedParams(getRuntimeFormulas(C.Data.Post, FormulaType::AND), C.F);
+    }
+    collectWatchedObjects();
+    if (ClRestrictToRegions) {
+        for (ContractManagerAnalysis::Contract const& C : DB->Contracts) {
+            collectAccessRegions(getRuntimeFormulas(C.Data.Pre, FormulaType::AND), C.F, AM);
+            collectAccessRegions(getRuntimeFormulas(C.Data.Post, FormulaType::AND), C.F, AM);
+        }
+    }
+
+    // Collect first, so that analysing uses is not affected by inserted callbacks
+    std::vector<std::pair<Instruction*, Value*>> sites;
+    int num_accesses = 0;
+    int num_unwatched_kind = 0;
+    int num_unwatched_object = 0;
+    int num_outside_region = 0;
+    int num_profile_cold = 0;
     for (Function& F : M) {
+        if (fast_paths.contains(&F) || isExcluded(&F)) continue;
         for (BasicBlock& BB : F) {
             for (Instruction& I : BB) {
                 if (isa<LoadInst>(I) || isa<StoreInst>(I)) {
                     if (instrument_ignore.contains(&I)) continue;
                     Value* V = getLoadStorePointerOperand(&I);
                     // Fortran: Check if reading array metadata, and skip callback if so
-                    if (GEPOperator const* GEPOp = dyn_cast<GEPOperator>(V)) {
-                        if (GlobalVariable const* GV = dyn_cast<GlobalVariable>(GEPOp->getPointerOperand())) {
-                            SmallVector<DIGlobalVariableExpression*> dbg_arr;
-                            GV->getDebugInfo(dbg_arr);
-                            if (!isC && !dbg_arr.empty() && dbg_arr[0]->getVariable()->getType()->getTag() == (dwarf::Tag)DW_TAG_array_type) {
-                                continue;
-                            }
+                    if (GEPOperator const* GEPOp = !isC ? dyn_cast<GEPOperator>(V) : nullptr) {
+                        GlobalVariable const* GV = dyn_cast<GlobalVariable>(GEPOp->getPointerOperand());
+                        if (GV && isArrayDescriptor(GV)) continue;
+                    }
+                    num_accesses++;
+                    if (ClElideUnwatchedAccesses && !isRelevant(&I)) {
+                        if (!(isa<LoadInst>(I) ? has_watched_reads : has_watched_writes)) {
+                            num_unwatched_kind++;
+                            continue;
+                        }
+                        if (!mayAccessWatched(V)) {
+                            num_unwatched_object++;
+                            continue;
                         }
                     }
-                    insertCBIfNeeded(isa<LoadInst>(I) ? callbackRCallee : callbackWCallee, {V}, &I);
+                    if (ClRestrictToRegions && !isRelevant(&I) && !(isa<LoadInst>(I) ? read_regions : write_regions).contains(&I)) {
+                        num_outside_region++;
+                        continue;
+                    }
+                    // Sites never accessed during a release window in training are dropped, or only sampled
+                    if (!profile_files.empty() && !isRelevant(&I) && isProfileCold(&I, isa<StoreInst>(I))) {
+                        num_profile_cold++;
+                        if (!ClSampleMemory) continue;
+                    }
+                    sites.push_back({&I, V});
                 }
             }
         }
     }
+
+    FunctionAnalysisManager& FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    if (ClCloneCleanFunctions && !ClInstrumentType.starts_with("filtered"))
+        cloneCleanFunctions(M, sites, FAM);
+
+    // Relevant locations keep their own callback for coverage. Filtered instrumentation drops all others anyway
+    // No control flow is changed until all sites are analysed, so loop analyses stay valid
+    std::vector<std::pair<Instruction*, Value*>> remaining_sites;
+    int num_hoisted = 0;
+    bool hoist = ClHoistLoopAccesses && !ClInstrumentType.starts_with("filtered");
+    Function* curF = nullptr;
+    std::unique_ptr<SCEVExpander> Expander;
+    for (std::pair<Instruction*, Value*> const& site : sites) {
+        Function* F = site.first->getFunction();
+        if (hoist && !isRelevant(site.first)) {
+            if (F != curF) {
+                curF = F;
+                Expander = std::make_unique<SCEVExpander>(FAM.getResult<ScalarEvolutionAnalysis>(*F), M.getDataLayout(), "cover.range");
+            }
+            if (hoistLoopAccess(site.first, site.second, FAM.getResult<LoopAnalysis>(*F), FAM.getResult<ScalarEvolutionAnalysis>(*F), FAM.getResult<DominatorTreeAnalysis>(*F), *Expander)) {
+                num_hoisted++;
+                continue;
+            }
+        }
+        remaining_sites.push_back(site);
+    }
+    Expander.reset();
+
+    std::vector<CallInst*> callbacks;
+    for (std::pair<CallInst*, GlobalVariable*> const& range_cb : range_callbacks) {
+        if (ClGateCallbacks) gateInstruction(range_cb.first, range_cb.second, true);
+        callbacks.push_back(range_cb.first);
+    }
+    for (std::pair<Instruction*, Value*> const& site : remaining_sites) {
+        bool isLoad = isa<LoadInst>(site.first);
+        if (CallInst* CB = insertCBIfNeeded(isLoad ? callbackRCallee : callbackWCallee, {site.second}, site.first, isLoad ? memRGate : memWGate))
+            callbacks.push_back(CB);
+    }
+    if (ClSampleMemory && !profile_files.empty()) {
+        // Accesses seen during release windows in training are always checked
+        std::erase_if(callbacks, [&](CallInst const* CB) {
+            Value const* callee = CB->getCalledOperand();
+            return !isProfileCold(CB, callee == callbackWCallee.getCallee() || callee == callbackRangeWCallee.getCallee());
+        });
+    }
+    if (ClSampleMemory) insertSampling(M, callbacks);
+    if (hoist)
+        errs() << "CoVer: Replaced " << num_hoisted << " memory access callbacks in loops by range callbacks\n";
+
+    if (ClElideUnwatchedAccesses)
+        errs() << "CoVer: Elided callbacks for " << num_unwatched_kind + num_unwatched_object << " of " << num_accesses << " memory accesses ("
+               << num_unwatched_kind << " without read!/write! contract, " << num_unwatched_object << " to unwatched objects)\n";
+    if (ClRestrictToRegions)
+        errs() << "CoVer: Elided callbacks for " << num_outside_region << " memory accesses outside of supplier-release regions\n";
+    if (!profile_files.empty())
+        errs() << "CoVer: " << (ClSampleMemory ? "Sampled" : "Elided") << " callbacks for " << num_profile_cold << " memory accesses never accessed during a release window in the training profile\n";
+}
+
+struct IterTypeRegion {
+    const CallBase* callsite;
+    const std::string releaseFunc;
+    const std::vector<CallParam> releaseParam;
+    const bool isTagRel;
+    std::map<Function*, std::vector<TagUnit>> const& Tags;
+    ModuleAnalysisManager* MAM;
+};
+
+static bool transferRegion(bool open, const Instruction* I, void* data) {
+    if (!open) return open;
+    IterTypeRegion* Data = static_cast<IterTypeRegion*>(data);
+    const CallBase* CB = dyn_cast<CallBase>(I);
+    if (!CB || !ContractPassUtility::checkCalledApplies(CB, Data->releaseFunc, Data->isTagRel, Data->Tags)) return open;
+    if (Data->releaseParam.empty()) return false;
+    for (CallParam const& P : Data->releaseParam) {
+        if (ContractPassUtility::checkCallParamApplies(Data->callsite, CB, Data->releaseFunc, P, Data->Tags, Data->MAM)) return false;
+    }
+    // Releases a different buffer
+    return open;
+}
+
+static std::pair<bool,bool> mergeRegion(bool prev, bool cur, const Instruction* I, void* data) {
+    // May analysis: Open if open on any path. Continue if the region grew
+    return { prev || cur, prev && !cur };
+}
+
+void InstrumentPass::collectAccessRegions(std::vector<std::shared_ptr<ContractFormula>> const& forms, Function* supplier, ModuleAnalysisManager& AM) {
+    for (std::shared_ptr<ContractFormula> const& form : forms) {
+        collectAccessRegions(getRuntimeFormulas(form->Children, form->type), supplier, AM);
+        if (!form->Children.empty()) continue;
+        std::shared_ptr<const Operation> OP = static_pointer_cast<ContractExpression>(form)->OP;
+        if (OP->type() != OperationType::RELEASE) continue;
+        std::shared_ptr<const ReleaseOperation> relOP = static_pointer_cast<const ReleaseOperation>(OP);
+        if (relOP->Forbidden->type() != OperationType::READ && relOP->Forbidden->type() != OperationType::WRITE) continue;
+        std::set<Instruction const*>& regions = relOP->Forbidden->type() == OperationType::READ ? read_regions : write_regions;
+        std::shared_ptr<const CallOperation> untilOP = static_pointer_cast<const CallOperation>(relOP->Until);
+
+        // Accesses are only forbidden from a supplier call until its release, so follow the program from each callsite
+        for (User* U : supplier->users()) {
+            CallBase const* CB = dyn_cast<CallBase>(U);
+            if (!CB || CB->getCalledOperand() != supplier) continue;
+            if (ClStaticVerdicts && form->SafeCallsites->contains(CB)) continue; // No buffer is watched for this callsite
+            IterTypeRegion data = { CB, untilOP->Function, untilOP->Params, relOP->Until->type() == OperationType::CALLTAG, DB->Tags, &AM };
+            std::map<const Instruction*, bool> AnalysisInfo = ContractPassUtility::GenericWorklist<bool>(CB->getNextNode(), transferRegion, mergeRegion, &data, true);
+            for (std::pair<const Instruction* const, bool> const& info : AnalysisInfo) {
+                if (info.second) regions.insert(info.first);
+            }
+        }
+    }
+}
+
+bool InstrumentPass::mayChangeWatches(CallBase const& CB) const {
+    // Calls to intrinsics and functions without memory effects cannot lead to a function callback.
+    // All code of the program is linked into this module, so other declarations are libraries. These only reach a
+    // callback through function pointers passed to them, e.g. comparators
+    if (CB.isInlineAsm()) return false;
+    Function const* Callee = CB.getCalledFunction();
+    if (!Callee) return true;
+    if (Callee->isIntrinsic() || CB.doesNotAccessMemory()) return false;
+    if (watch_changing.contains(Callee)) return true;
+    if (!Callee->isDeclaration()) return false;
+    return std::any_of(CB.arg_begin(), CB.arg_end(), [&](Use const& Arg) {
+        Function const* ArgF = dyn_cast<Function>(Arg->stripPointerCasts());
+        return ArgF && watch_changing.contains(ArgF);
+    });
 }
 
-std::pair<Constant*,int64_t> InstrumentPass::createParamList(Module& M, std::vector<CallParam> params) {
-    if (params.empty()) return { Null_Const, 0 };
-    std::vector<Constant*> paramConsts;
-    for (CallParam param : params) {
-        Constant* pConst = ConstantStruct::get(Param_Type, {ConstantInt::get(Int_Type, param.callP), ConstantInt::getBool(Bool_Type, param.callPisTagVar), ConstantInt::get(Int_Type, param.contrP), ConstantInt::get(Int_Type, (int64_t)param.contrParamAccess)});
-        paramConsts.push_back(pConst);
+void InstrumentPass::collectWatchChangingFunctions(Module const& M) {
+    // Buffers are only watched or released in function callbacks, i.e. when calling a function with contracts or tags.
+    // A function may change the watches if it calls one of these or another function that may, up to a fixed point
+    for (ContractManagerAnalysis::Contract const& C : DB->Contracts) watch_changing.insert(C.F);
+    for (std::pair<Function* const, std::vector<TagUnit>> const& functags : DB->Tags) watch_changing.insert(functags.first);
+    watch_changing.insert(mentioned_funcs.begin(), mentioned_funcs.end());
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Function const& F : M) {
+            if (F.isDeclaration() || watch_changing.contains(&F)) continue;
+            for (Instruction const& I : instructions(F)) {
+                CallBase const* CB = dyn_cast<CallBase>(&I);
+                if (!CB || !mayChangeWatches(*CB)) continue;
+                watch_changing.insert(&F);
+                changed = true;
+                break;
+            }
+        }
+    }
+}
+
+void InstrumentPass::cloneCleanFunctions(Module& M, std::vector<std::pair<Instruction*, Value*>> const& sites, FunctionAnalysisManager& FAM) {
+    // Functions which may not change the watched buffers during execution can run uninstrumented if none are watched on entry.
+    // Functions with relevant locations always run instrumented, as these are recorded for coverage
+    collectWatchChangingFunctions(M);
+    DenseMap<Function*, int> num_sites;
+    SmallPtrSet<Function*, 16> has_relevant;
+    for (std::pair<Instruction*, Value*> const& site : sites) {
+        Function* F = site.first->getFunction();
+        num_sites[F]++;
+        if (isRelevant(site.first)) has_relevant.insert(F);
+    }
+    std::vector<std::pair<Function*, int>> candidates;
+    for (std::pair<Function*, int> const& entry : num_sites) {
+        Function* F = entry.first;
+        if (F->getName() == "main" || F->isVarArg() || has_relevant.contains(F) || watch_changing.contains(F)) continue;
+        // Arguments passed in the caller's frame cannot be forwarded by a plain call
+        if (std::any_of(F->arg_begin(), F->arg_end(), [](Argument const& A) { return A.hasInAllocaAttr() || A.hasPreallocatedAttr(); })) continue;
+        candidates.push_back(entry);
+    }
+    // Prefer functions with the most callbacks
+    std::sort(candidates.begin(), candidates.end(), [](std::pair<Function*, int> const& a, std::pair<Function*, int> const& b) {
+        return a.second > b.second;
+    });
+
+    uint64_t module_size = 0;
+    for (Function const& F : M) module_size += F.getInstructionCount();
+    uint64_t const size_limit = module_size * ClCloneSizeLimit / 100;
+    uint64_t added_size = 0;
+    int num_cloned = 0;
+    for (std::pair<Function*, int> const& candidate : candidates) {
+        Function* F = candidate.first;
+        if (added_size + F->getInstructionCount() > size_limit) continue;
+        added_size += F->getInstructionCount();
+        num_cloned++;
+
+        ValueToValueMapTy VMap;
+        Function* Clean = CloneFunction(F, VMap);
+        Clean->setName(F->getName() + ".cover_clean");
+        Clean->setLinkage(GlobalValue::InternalLinkage);
+        Clean->setVisibility(GlobalValue::DefaultVisibility);
+
+        // Dispatch after the static allocas, so these stay in the entry block
+        BasicBlock::iterator InsertPt = F->getEntryBlock().getFirstNonPHIOrDbgOrAlloca();
+        LoadInst* gateR = new LoadInst(Int_Type, memRGate, "cover.gate.r", InsertPt);
+        LoadInst* gateW = new LoadInst(Int_Type, memWGate, "cover.gate.w", InsertPt);
+        Value* anyWatched = BinaryOperator::CreateOr(gateR, gateW, "cover.gate", InsertPt);
+        Value* noneWatched = new ICmpInst(InsertPt, ICmpInst::ICMP_EQ, anyWatched, ConstantInt::get(Int_Type, 0), "cover.clean");
+        Instruction* cleanTerm = SplitBlockAndInsertIfThen(noneWatched, InsertPt, true);
+        std::vector<Value*> args;
+        for (Argument& A : F->args()) args.push_back(&A);
+        CallInst* cleanCI = CallInst::Create(Clean, args, "", cleanTerm->getIterator());
+        cleanCI->setCallingConv(F->getCallingConv());
+        cleanCI->setAttributes(F->getAttributes());
+        // Byval copies live in the frame of F, which a tail call must not access
+        if (std::none_of(F->arg_begin(), F->arg_end(), [](Argument const& A) { return A.hasByValAttr(); })) cleanCI->setTailCall();
+        if (DISubprogram* SP = F->getSubprogram()) cleanCI->setDebugLoc(DILocation::get(M.getContext(), SP->getLine(), 0, SP));
+        ReturnInst::Create(M.getContext(), F->getReturnType()->isVoidTy() ? nullptr : cleanCI, cleanTerm->getIterator());
+        cleanTerm->eraseFromParent();
+        instrument_ignore.insert(gateR);
+        instrument_ignore.insert(gateW);
+        FAM.invalidate(*F, PreservedAnalyses::none());
     }
-    ArrayType* paramArr_Type = ArrayType::get(Param_Type, paramConsts.size());
-    Constant* res = ConstantArray::get(paramArr_Type, paramConsts);
-    return {createConstantGlobalUnique(M, res, "CONTR_PARAMLIST"), paramConsts.size()};
+
+    errs() << "CoVer: Created uninstrumented copies of " << num_cloned << " of " << num_sites.size() << " functions with memory callbacks, adding "
+           << added_size << " instructions (" << (module_size ? added_size * 100 / module_size : 0) << "% of module, limit " << ClCloneSizeLimit << "%)\n";
 }
 
 void InstrumentPass::insertFunctionInstrCallback(Function* F) {
     if (already_instrumented.contains(F)) return;
+    // Fortran callsites need per-callsite parameter handling, see below
+    if (!ClInstrumentWrappers.empty() && isC && !F->isVarArg()) {
+        insertFunctionWrapper(F);
+        already_instrumented.insert(F);
+        return;
+    }
     std::vector<CallBase*> callsites;
     for (User* U : F->users()) {
         if (CallBase* CB = dyn_cast<CallBase>(U)) {
-            callsites.push_back(CB);
+            if (CB->getCalledOperand() == F && !isExcluded(CB->getFunction())) callsites.push_back(CB);
         }
     }
-    for (CallBase* callsite : callsites) {
+    uint32_t const callee = getFunctionIndex(F);
+    num_calls[callee] = callsites.size();
+    Constant* gate = ConstantExpr::getInBoundsGetElementPtr(gatesGlobal->getValueType(), gatesGlobal, ArrayRef<Constant*>({ConstantInt::get(Int_Type, 0), ConstantInt::get(Int_Type, callee)}));
+    // Ascending indices of the passed parameters, so that callsites with fewer arguments pass a prefix
+    std::set<int> const& used = used_params[F];
+    std::vector<int32_t> used_idx(used.begin(), used.end());
+    GlobalVariable* paramIdxGlobal = createConstantGlobal(*F->getParent(), ConstantDataArray::get(F->getContext(), used_idx), "CONTR_PARAMIDX_" + F->getName().str());
+    std::vector<std::shared_ptr<std::set<CallBase const*>>> const& bits = verdict_bits[F];
+    for (uint32_t call = 0; call < callsites.size(); call++) {
+        CallBase* callsite = callsites[call];
         int skipnum = 0;
+        uint64_t proven = 0;
+        for (size_t i = 0; i < bits.size(); i++) {
+            if (bits[i]->contains(callsite)) proven |= 1ull << i;
+        }
+        if (proven) num_proven_callsites++;
         std::vector<Value*> params;
-        params.push_back(callsite->getCalledOperand()); // First param is funcptr
-        params.push_back(ConstantInt::get(Int_Type, callsite->arg_size()));
+        params.push_back(GlobalDB);
+        params.push_back(ConstantInt::get(Int_Type, callee));
+        params.push_back(ConstantInt::get(Int_Type, call));
+        params.push_back(ConstantInt::get(Int64_Type, proven));
+        params.push_back(paramIdxGlobal);
+        params.push_back(nullptr); // Number of passed params, set below
         for (Use const& U : callsite->args()) {
             Value* actual_param = U;
             int const cur_argno = callsite->getArgOperandNo(&U);
             if (cur_argno >= callsite->arg_size() - skipnum) break;
+            if (!used.contains(cur_argno)) {
+                if (!isC && checkIsStrParam(U)) skipnum++;
+                continue;
+            }
 
-            // Store size of data type
             if (isC) {
-                params.push_back(ConstantInt::get(Int_Type, callsite->getDataLayout().getTypeStoreSizeInBits(U->getType())));
-                // Store actual parameter, making sure to cast if necessary
-                if (!U->getType()->isPointerTy()) {
-                    if (U->getType()->isFloatingPointTy()) {
-                        actual_param = CastInst::Create(Instruction::CastOps::BitCast, actual_param, Int_Type, "", callsite->getIterator());
-                    }
-                    // Now, actual pointer cast
-                    actual_param = CastInst::Create(Instruction::CastOps::IntToPtr, actual_param, Ptr_Type, "", callsite->getIterator());
-                }
+                appendCParam(params, actual_param, callsite);
+                continue;
             } else {
-                if (Function const* F = dyn_cast<Function>(callsite->getCalledOperand())) {
-                    DISubprogram const* Dbg = F->getSubprogram();
+                if (F->getSubprogram()) {
+                    std::vector<ParamDebugInfo> const& param_info = getParamDebugInfo(F);
                     if (checkIsStrParam(U)) skipnum++;
-                    if (Dbg->getType()->getTypeArray()->getNumOperands() <= cur_argno + 1) {
+                    if (param_info.size() <= cur_argno) {
                         errs() << "Warning: During instrumentation, likely string param missed during detection. Normal if optimizations enabled.\n";
                         errs() << "If unsure, check if function " << F->getName() << " has more than " << skipnum << " string arguments.\n";
                         break;
                     }
                     // All parameters are sent as pointers. Need to check exact size using dbg info
-                    DIType const* param_type = Dbg->getType()->getTypeArray()[cur_argno + 1]; // Offset by one, first is ret val
-                    params.push_back(ConstantInt::get(Int_Type, param_type->getSizeInBits() == 0 || isa<GlobalValue>(actual_param) ? 64 : param_type->getSizeInBits()));
+                    ParamDebugInfo const& param_type = param_info[cur_argno];
+                    params.push_back(ConstantInt::get(Int_Type, param_type.size_bits == 0 || isa<GlobalValue>(actual_param) ? 64 : param_type.size_bits));
                     // On Fortran, deref if param is an allocate/ptr buffer
-                    if (param_type->getTag() == (dwarf::Tag)DW_TAG_array_type) {
+                    if (param_type.is_array) {
                         actual_param = new LoadInst(Ptr_Type, actual_param, "", callsite->getIterator());
                     }
                 } else {
-                    errs() << "ERROR: Could not perform instrumentation! Unable to get debug info for function \"" << callsite->getCalledOperand()->getName() << "\"";
+                    errs() << "ERROR: Could not perform instrumentation! Unable to get debug info for function \"" << F->getName() << "\"";
                 }
             }
             params.push_back(actual_param);
         }
-        insertCBIfNeeded(callbackFuncCallee, params, callsite);
+        params[5] = ConstantInt::get(Int_Type, (params.size() - 6) / 2);
+        insertCBIfNeeded(callbackFuncCallee, params, callsite, gate);
     }
     already_instrumented.insert(F);
 }
 
-void InstrumentPass::insertCBIfNeeded(FunctionCallee FC, std::vector<Value *> params, Instruction* I) {
-    if (!isRelevant(I) && (isa<LoadInst>(I) || isa<StoreInst>(I)) && ClInstrumentType.starts_with("filtered")) return;
-    params.insert(params.begin(), ConstantInt::getBool(Bool_Type, isRelevant(I)));
+void InstrumentPass::appendCParam(std::vector<Value*>& params, Value* actual_param, Instruction* InsertBefore) {
+    // Store size of data type
+    params.push_back(ConstantInt::get(Int_Type, InsertBefore->getDataLayout().getTypeStoreSizeInBits(actual_param->getType())));
+    // Store actual parameter, making sure to cast if necessary
+    if (!actual_param->getType()->isPointerTy()) {
+        if (actual_param->getType()->isFloatingPointTy()) {
+            actual_param = CastInst::Create(Instruction::CastOps::BitCast, actual_param, Int_Type, "", InsertBefore->getIterator());
+        }
+        // Now, actual pointer cast
+        actual_param = CastInst::Create(Instruction::CastOps::IntToPtr, actual_param, Ptr_Type, "", InsertBefore->getIterator());
+    }
+    params.push_back(actual_param);
+}
+
+void InstrumentPass::insertFunctionWrapper(Function* F) {
+    Module& M = *F->getParent();
+    uint32_t const callee = getFunctionIndex(F);
+    Constant* gate = ConstantExpr::getInBoundsGetElementPtr(gatesGlobal->getValueType(), gatesGlobal, ArrayRef<Constant*>({ConstantInt::get(Int_Type, 0), ConstantInt::get(Int_Type, callee)}));
+    std::vector<CallBase*> callsites;
+    std::vector<CallBase*> excluded_callsites;
+    for (User* U : F->users())
+        if (CallBase* CB = dyn_cast<CallBase>(U); CB && CB->getCalledOperand() == F)
+            (isExcluded(CB->getFunction()) ? excluded_callsites : callsites).push_back(CB);
+
+    // Interposed MPI functions are defined here and forward to the profiling interface, so that calls from uninstrumented libraries are seen as well
+    Function* wrapper;
+    FunctionCallee target;
+    if (ClInstrumentWrappers == "interpose" && F->isDeclaration() && F->getName().starts_with("MPI_")) {
+        wrapper = F;
+        wrapper->setLinkage(GlobalValue::WeakAnyLinkage);
+        target = M.getOrInsertFunction(("P" + F->getName()).str(), F->getFunctionType(), F->getAttributes());
+        num_interposed++;
+        // Excluded callers bypass the interposed definition
+        for (CallBase* callsite : excluded_callsites) callsite->setCalledOperand(target.getCallee());
+    } else {
+        wrapper = Function::Create(F->getFunctionType(), GlobalValue::InternalLinkage, F->getName() + ".cover_wrapper", M);
+        wrapper->setAttributes(F->getAttributes());
+        wrapper->removeFnAttr(Attribute::Memory);
+        target = F;
+    }
+    num_wrapped++;
+
+    // Coverage is still recorded at the callsites
+    for (CallBase* callsite : callsites) {
+        if (std::optional<uint32_t> counter = getReferenceCounter(callsite)) insertCoverageCounter(callsite, *counter);
+        if (wrapper != F) callsite->setCalledOperand(wrapper);
+    }
+
+    BasicBlock* entry = BasicBlock::Create(M.getContext(), "entry", wrapper);
+    std::vector<Value*> args;
+    for (Argument& A : wrapper->args()) args.push_back(&A);
+    CallInst* forward = CallInst::Create(target, args, "", entry);
+    forward->setCallingConv(F->getCallingConv());
+    forward->setTailCall();
+    if (forward->getType()->isVoidTy()) ReturnInst::Create(M.getContext(), entry);
+    else ReturnInst::Create(M.getContext(), forward, entry);
+
+    // The runtime tells callsites apart by the return address of the wrapper
+    std::vector<int32_t> used_idx(used_params[F].begin(), used_params[F].end());
+    std::vector<Value*> params;
+    params.push_back(CallInst::Create(Intrinsic::getOrInsertDeclaration(&M, Intrinsic::returnaddress), {ConstantInt::get(Int_Type, 0)}, "cover.caller", forward->getIterator()));
+    params.push_back(GlobalDB);
+    params.push_back(ConstantInt::get(Int_Type, callee));
+    params.push_back(createConstantGlobal(M, ConstantDataArray::get(M.getContext(), used_idx), "CONTR_PARAMIDX_" + F->getName().str()));
+    params.push_back(nullptr); // Number of passed params, set below
+    for (int32_t argno : used_idx)
+        if (argno < (int32_t)wrapper->arg_size()) appendCParam(params, wrapper->getArg(argno), forward);
+    params[4] = ConstantInt::get(Int_Type, (params.size() - 5) / 2);
+    CallInst* callbackCI = CallInst::Create(callbackWrapperCallee, params, "", forward->getIterator());
+    if (ClGateCallbacks) gateInstruction(callbackCI, gate, false);
+}
+
+CallInst* InstrumentPass::insertCBIfNeeded(FunctionCallee FC, std::vector<Value *> params, Instruction* I, Constant* Gate) {
+    std::optional<uint32_t> counter = getReferenceCounter(I);
+    bool relevant = counter.has_value();
+    if (relevant) insertCoverageCounter(I, *counter);
+    if (!relevant && (isa<LoadInst>(I) || isa<StoreInst>(I)) && ClInstrumentType.starts_with("filtered")) return nullptr;
+    params.insert(params.begin(), ConstantInt::get(Int_Type, getSiteId(I)));
     CallInst* callbackCI = CallInst::Create(FC, params);
     callbackCI->setDebugLoc(I->getDebugLoc());
     callbackCI->insertBefore(I->getIterator());
+    if (ClGateCallbacks) gateInstruction(callbackCI, Gate, Gate == memRGate || Gate == memWGate);
+    return callbackCI;
 }
 
-bool InstrumentPass::isRelevant(Instruction const* I) const {
-    FileReference f = ContractPassUtility::getFileReference(I);
-    for (ErrorMessage const& msg : err_msgs) {
-        for (FileReference const& ref : msg.references) if (ref == f) return true;
+void InstrumentPass::insertSampling(Module& M, std::vector<CallInst*> const& callbacks) {
+    // Countdown per callback site. Zero-initialized, so that the first access of each site is checked
+    ArrayType* Countdown_Type = ArrayType::get(Int_Type, callbacks.size());
+    GlobalVariable* countdowns = new GlobalVariable(M, Countdown_Type, false, GlobalValue::InternalLinkage, ConstantAggregateZero::get(Countdown_Type), "CONTR_SAMPLE_COUNTDOWNS");
+    GlobalVariable* period = dyn_cast<GlobalVariable>(M.getOrInsertGlobal("PPDCV_SamplePeriod", Int_Type));
+    period->setLinkage(GlobalValue::ExternalWeakLinkage);
+    for (size_t i = 0; i < callbacks.size(); i++) {
+        CallInst* CB = callbacks[i];
+        Constant* countdown = ConstantExpr::getInBoundsGetElementPtr(Countdown_Type, countdowns, ArrayRef<Constant*>({ConstantInt::get(Int_Type, 0), ConstantInt::get(Int_Type, i)}));
+        LoadInst* count = new LoadInst(Int_Type, countdown, "cover.sample", CB->getIterator());
+        Value* next = BinaryOperator::CreateSub(count, ConstantInt::get(Int_Type, 1), "cover.sample.next", CB->getIterator());
+        Value* sampled = new ICmpInst(CB->getIterator(), ICmpInst::ICMP_SLE, next, ConstantInt::get(Int_Type, 0), "cover.sample.taken");
+        // Restart the countdown with the current period once the callback is taken
+        LoadInst* curPeriod = new LoadInst(Int_Type, period, "cover.sample.period", CB->getIterator());
+        StoreInst* store = new StoreInst(SelectInst::Create(sampled, curPeriod, next, "", CB->getIterator()), countdown, CB->getIterator());
+        instrument_ignore.insert({count, curPeriod, store});
+        Instruction* thenTerm = SplitBlockAndInsertIfThen(sampled, CB->getIterator(), false, MDBuilder(M.getContext()).createUnlikelyBranchWeights());
+        CB->moveBefore(thenTerm->getIterator());
     }
-    return false;
+    errs() << "CoVer: Sampling " << callbacks.size() << " memory callback sites\n";
+}
+
+void InstrumentPass::insertCoverageCounter(Instruction* I, uint32_t counter) {
+    // Saturating increment, so that frequently executed locations are not reported as unvisited
+    Constant* counterPtr = ConstantExpr::getInBoundsGetElementPtr(countersGlobal->getValueType(), countersGlobal, ArrayRef<Constant*>({ConstantInt::get(Int_Type, 0), ConstantInt::get(Int_Type, counter)}));
+    LoadInst* count = new LoadInst(Int8_Type, counterPtr, "cover.counter", I->getIterator());
+    Value* notFull = new ICmpInst(I->getIterator(), ICmpInst::ICMP_NE, count, ConstantInt::get(Int8_Type, UINT8_MAX), "cover.counter.notfull");
+    Value* inc = BinaryOperator::CreateAdd(count, new ZExtInst(notFull, Int8_Type, "", I->getIterator()), "cover.counter.inc", I->getIterator());
+    StoreInst* store = new StoreInst(inc, counterPtr, I->getIterator());
+    instrument_ignore.insert(count);
+    instrument_ignore.insert(store);
+}
+
+void InstrumentPass::gateInstruction(Instruction* I, Constant* Gate, bool rarelyOpen) {
+    LoadInst* gateVal = new LoadInst(Int_Type, Gate, "cover.gate", I->getIterator());
+    Value* isOpen = new ICmpInst(I->getIterator(), ICmpInst::ICMP_NE, gateVal, ConstantInt::get(Int_Type, 0), "cover.gate.open");
+    MDNode* weights = rarelyOpen ? MDBuilder(I->getContext()).createUnlikelyBranchWeights() : nullptr;
+    Instruction* thenTerm = SplitBlockAndInsertIfThen(isOpen, I->getIterator(), false, weights);
+    I->moveBefore(thenTerm->getIterator());
+    instrument_ignore.insert(gateVal);
+}
+
+bool InstrumentPass::isExcluded(Function const* F) {
+    auto cached = excluded_functions.find(F);
+    if (cached != excluded_functions.end()) return cached->second;
+    std::string const demangled = demangle(F->getName());
+    StringRef const mainfile = F->getParent()->getSourceFileName();
+    StringRef src = mainfile;
+    if (DISubprogram const* SP = F->getSubprogram()) src = SP->getFilename();
+    auto matches = [&](SpecialCaseList const& list) {
+        return list.inSection("cover", "fun", F->getName()) || list.inSection("cover", "fun", demangled)
+            || list.inSection("cover", "src", src) || list.inSection("cover", "mainfile", mainfile);
+    };
+    bool const excluded = (ignorelist && matches(*ignorelist)) || (allowlist && !matches(*allowlist));
+    excluded_functions[F] = excluded;
+    return excluded;
+}
+
+uint32_t InstrumentPass::getFileId(StringRef file) {
+    auto it = file_ids.try_emplace(file, file_names.size());
+    if (it.second) file_names.push_back(file.str());
+    return it.first->second;
+}
+
+InstrumentPass::LocationKey InstrumentPass::getLocationKey(Instruction const* I) {
+    // Same file, line and column as ContractPassUtility::getFileReference, but the file name is only built once per DIFile
+    DebugLoc const& Loc = I->getDebugLoc();
+    if (!Loc) return {getFileId(ContractPassUtility::getFile(I)), 0, 0};
+    auto cached = difile_ids.find(Loc->getFile());
+    uint32_t file = cached != difile_ids.end() ? cached->second : (difile_ids[Loc->getFile()] = getFileId(ContractPassUtility::getFile(I)));
+    return {file, Loc.getLine(), Loc->getColumn()};
+}
+
+std::optional<uint32_t> InstrumentPass::getReferenceCounter(Instruction const* I) {
+    if (reference_locations.empty()) return std::nullopt;
+    auto counter = reference_locations.find(getLocationKey(I));
+    if (counter == reference_locations.end()) return std::nullopt;
+    return counter->second;
+}
+
+bool InstrumentPass::isRelevant(Instruction const* I) {
+    return getReferenceCounter(I).has_value();
+}
+
+bool InstrumentPass::isArrayDescriptor(GlobalVariable const* GV) {
+    auto cached = array_descriptors.find(GV);
+    if (cached != array_descriptors.end()) return cached->second;
+    SmallVector<DIGlobalVariableExpression*> dbg_arr;
+    GV->getDebugInfo(dbg_arr);
+    bool result = !dbg_arr.empty() && dbg_arr[0]->getVariable()->getType()->getTag() == (dwarf::Tag)DW_TAG_array_type;
+    array_descriptors[GV] = result;
+    return result;
+}
+
+std::vector<InstrumentPass::ParamDebugInfo> const& InstrumentPass::getParamDebugInfo(Function const* F) {
+    auto cached = param_debug_info.find(F);
+    if (cached != param_debug_info.end()) return cached->second;
+    std::vector<ParamDebugInfo>& params = param_debug_info[F];
+    DITypeRefArray types = F->getSubprogram()->getType()->getTypeArray();
+    for (unsigned i = 1; i < types.size(); i++) // Offset by one, first is ret val
+        params.push_back({types[i]->getSizeInBits(), types[i]->getTag() == (dwarf::Tag)DW_TAG_array_type});
+    return params;
+}
+
+bool InstrumentPass::isProfileCold(Instruction const* I, bool isWrite) {
+    // Sites without location, or in source files not instrumented in the training run, are kept
+    if (!I->getDebugLoc()) return false;
+    LocationKey loc = getLocationKey(I);
+    std::string const& file = file_names[std::get<0>(loc)];
+    if (!profile_files.contains(file)) return false;
+    // Same format as the site locations written by the runtime
+    return !profile_hot_sites.contains((isWrite ? "write " : "read ") + file + ":" + std::to_string(std::get<1>(loc)) + ":" + std::to_string(std::get<2>(loc)));
 }
 
 bool InstrumentPass::checkIsStrParam(Value const* V) {
@@ -1,15 +1,30 @@
 #pragma once
 
 #include "llvm/IR/PassManager.h"
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/Transforms/Utils/ScalarEvolutionExpander.h>
 #include <llvm/IR/Constant.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/InstrTypes.h>
 #include <llvm/IR/Instruction.h>
+#include <llvm/Support/SpecialCaseList.h>
+#include <cstring>
+#include <map>
 #include <memory>
+#include <optional>
+#include <tuple>
 #include <set>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
+#include "ContractDBImage.h"
 #include "ContractManager.hpp"
 #include "ContractTree.hpp"
 #include "ErrorMessage.h"
@@ -21,49 +36,127 @@ class InstrumentPass : public PassInfoMixin<InstrumentPass> {
         PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
 
     private:
-        // Structure Creation
-        Constant* createTagGlobal(Module &M); // Returns type, value
-        std::pair<Constant*, int64_t> createReferencesGlobal(Module &M);
-        std::pair<Constant*, int64_t> createContractsGlobal(Module& M); // Returns value, number of elems (type is ptr)
-        Constant* createScopeGlobal(Module& M, std::vector<std::shared_ptr<ContractFormula>> forms); // Returns value, number of elems (type is ptr)
-        Constant* createFormulaGlobal(Module& M, std::shared_ptr<ContractFormula> form);
-        Constant* createOperationGlobal(Module& M, std::shared_ptr<const Operation> op);
-        std::pair<Constant*,int64_t> createParamList(Module& M, std::vector<CallParam> p);
+        // Database Image
+        GlobalVariable* createImageGlobal(Module& M);
+        void finalizeImageGlobal(Module& M, GlobalVariable* image);
+        uint32_t getSiteId(Instruction const* I); // Adds the location of I to the site table
+        void encodeTags(DBHeader_t& header);
+        void encodeReferences(DBHeader_t& header);
+        void encodeContracts(Module& M, DBHeader_t& header);
+        std::vector<std::shared_ptr<ContractFormula>> getRuntimeFormulas(std::vector<std::shared_ptr<ContractFormula>> const& forms, FormulaType connective);
+        int countOperations(std::vector<std::shared_ptr<ContractFormula>> const& forms);
+        int countEncodedOperations(std::vector<std::shared_ptr<ContractFormula>> const& forms, FormulaType connective);
+        uint32_t encodeScope(Module& M, std::vector<std::shared_ptr<ContractFormula>> const& forms); // Returns offset of scope formula
+        uint32_t encodeFormulas(Module& M, std::vector<std::shared_ptr<ContractFormula>> const& forms); // Returns offset of first formula
+        DBFormula_t encodeFormula(Module& M, std::shared_ptr<ContractFormula> const& form);
+        int32_t getVerdictBit(std::shared_ptr<ContractFormula> const& form);
+        uint32_t encodeOperation(Module& M, std::shared_ptr<const Operation> const& op);
+        std::pair<uint32_t, uint32_t> encodeParamList(std::vector<CallParam> const& params); // Returns offset, number of elems
+        uint32_t getStringOffset(StringRef str);
+        uint32_t getFunctionIndex(Function* F);
+        template <typename T> uint32_t reserveRecords(size_t count) {
+            uint32_t offset = db_blob.size();
+            db_blob.resize(offset + count * sizeof(T));
+            return offset;
+        }
+        template <typename T> void writeRecord(uint32_t offset, T const& record) {
+            memcpy(db_blob.data() + offset, &record, sizeof(T));
+        }
+        template <typename T> uint32_t appendRecord(T const& record) {
+            uint32_t offset = reserveRecords<T>(1);
+            writeRecord(offset, record);
+            return offset;
+        }
+        template <typename T> uint32_t appendRecords(std::vector<T> const& records) {
+            uint32_t offset = reserveRecords<T>(records.size());
+            if (!records.empty()) memcpy(db_blob.data() + offset, records.data(), records.size() * sizeof(T));
+            return offset;
+        }
+        std::string db_blob;
+        std::string db_strings;
+        StringMap<uint32_t> db_string_offsets;
+        std::vector<Function*> db_functions;
+        DenseMap<Function*, uint32_t> db_function_ids;
+        std::vector<Constant*> image_fields;
+        GlobalVariable* GlobalDB; // Passed to the runtime on registration, and by function callbacks to identify the module
+        std::vector<uint32_t> num_calls; // Instrumented callsites per function, indexed like the function table
+        std::vector<DBSite_t> sites; // File is an offset into site_files until finalized
+        std::string site_files;
+        DenseMap<uint32_t, uint32_t> site_file_offsets; // By file id
+        Function* encoding_supplier = nullptr; // Supplier of the contract currently encoded
+        std::map<Function*, std::vector<std::shared_ptr<std::set<CallBase const*>>>> verdict_bits; // Safe callsites of each verdict bit, per supplier
+        int num_proven_callsites = 0;
+        int num_wrapped = 0;
+        int num_interposed = 0;
 
         // Auxiliary
-        GlobalVariable* createConstantGlobalUnique(Module& M, Constant* C, std::string name);
         GlobalVariable* createConstantGlobal(Module& M, Constant* C, std::string name);
         void createTypes(Module& M);
+        void linkFastPaths(Module& M);
+        void useFastPath(Module& M, FunctionCallee& callback, StringRef name);
+        void writeInstrumentReport(Module& M);
 
         // Instrumentation
         void instrumentFunctions(Module &M);
-        void instrumentRW(Module &M);
+        void instrumentRW(Module &M, ModuleAnalysisManager &AM);
+        bool hoistLoopAccess(Instruction* I, Value* Ptr, LoopInfo& LI, ScalarEvolution& SE, DominatorTree& DT, SCEVExpander& Expander);
+        bool loopHasCalls(Loop const* L);
+        void collectWatchedParams(std::vector<std::shared_ptr<ContractFormula>> const& forms, Function* supplier);
+        void collectUsedParams(Module& M, std::vector<std::shared_ptr<ContractFormula>> const& forms, Function* supplier);
+        void collectUsedParams(Module& M, std::shared_ptr<const Operation> const& op, Function* supplier);
+        void collectWatchedObjects();
+        void collectAccessRegions(std::vector<std::shared_ptr<ContractFormula>> const& forms, Function* supplier, ModuleAnalysisManager& AM);
+        bool mayAccessWatched(Value const* Ptr);
+        bool mayChangeWatches(CallBase const& CB) const;
+        void collectWatchChangingFunctions(Module const& M);
+        void cloneCleanFunctions(Module& M, std::vector<std::pair<Instruction*, Value*>> const& sites, FunctionAnalysisManager& FAM);
         void insertFunctionInstrCallback(Function* CB);
-        void insertCBIfNeeded(FunctionCallee FC, std::vector<Value *> params, Instruction* I);
-        bool isRelevant(Instruction const* I) const;
+        void insertFunctionWrapper(Function* F);
+        void appendCParam(std::vector<Value*>& params, Value* actual_param, Instruction* InsertBefore);
+        CallInst* insertCBIfNeeded(FunctionCallee FC, std::vector<Value *> params, Instruction* I, Constant* Gate);
+        void insertSampling(Module& M, std::vector<CallInst*> const& callbacks);
+        void gateInstruction(Instruction* I, Constant* Gate, bool rarelyOpen);
+        void insertCoverageCounter(Instruction* I, uint32_t counter);
+        bool isRelevant(Instruction const* I);
+        bool isExcluded(Function const* F); // By ignorelist or allowlist
+        bool isProfileCold(Instruction const* I, bool isWrite); // Not accessed during a release window in the training profile
+        bool hasRelevantCallsite(Function const* F);
         FunctionCallee callbackFuncCallee;
+        FunctionCallee callbackWrapperCallee;
         FunctionCallee callbackRCallee;
         FunctionCallee callbackWCallee;
+        FunctionCallee callbackRangeRCallee;
+        FunctionCallee callbackRangeWCallee;
+        SmallPtrSet<Function*, 4> fast_paths; // Callbacks defined in the module, see useFastPath
+        GlobalVariable* memRGate;
+        GlobalVariable* memWGate;
+        GlobalVariable* gatesGlobal; // Callee gates, indexed like the function table of the image
+        GlobalVariable* countersGlobal; // Coverage counters, indexed like reference_counters
+        std::vector<std::pair<CallInst*, GlobalVariable*>> range_callbacks;
         std::set<Function*> already_instrumented;
-        std::vector<Function*> mentioned_funcs; // Filled by callops (non-tag) in createOperation
+        std::vector<Function*> mentioned_funcs; // Filled by callops (non-tag) in encodeOperation
+        std::set<std::string> mentioned_tags; // Filled by calltag ops in encodeOperation
+        std::set<Function*> runtime_suppliers; // Suppliers with formulas left to check at runtime
+        std::set<Function const*> watch_changing; // Functions that may reach a function callback, see collectWatchChangingFunctions
+        std::map<Function*, std::set<int>> used_params; // Parameter indices referenced by any contract, per function
+
+        // Memory access elision
+        std::set<std::pair<Function*, int>> watched_params; // Supplier and index of parameters used by read!/write!
+        bool has_watched_reads = false;
+        bool has_watched_writes = false;
+        SmallPtrSet<Value const*, 16> watched_objects; // Underlying objects passed as watched parameters
+        DenseMap<Value const*, bool> object_may_be_watched;
+        DenseMap<Loop const*, bool> loop_has_calls;
+        std::set<Instruction const*> read_regions; // Instructions that may execute while a read!/write! release is pending
+        std::set<Instruction const*> write_regions;
 
         // Types
         PointerType* Ptr_Type;
-        IntegerType* Bool_Type;
+        IntegerType* Int8_Type;
         IntegerType* Int_Type;
+        IntegerType* Int64_Type;
         Type* Void_Type;
-        StructType* Formula_Type;
-        StructType* DB_Type;
-        StructType* Tag_Type;
-        StructType* Tags_Type;
-        StructType* Param_Type;
-        StructType* CallOp_Type;
-        StructType* CallTagOp_Type;
-        StructType* ReleaseOp_Type;
-        StructType* RWOp_Type;
-        StructType* Contract_Type;
-        StructType* Ref_Type;
-        Constant* Null_Const;
+        StructType* Image_Type;
 
         // Helpers
         bool checkIsStrParam(Value const* I);
@@ -72,7 +165,33 @@ class InstrumentPass : public PassInfoMixin<InstrumentPass> {
         bool isC = true;
 
         std::vector<ErrorMessage> err_msgs;
+        std::unordered_map<FileReference, uint32_t> reference_counters; // Coverage counter of each relevant reference location
+
+        // Per-instruction lookups use these indexes instead of building file names, see getLocationKey
+        using LocationKey = std::tuple<uint32_t, unsigned, unsigned>; // File id, line, column
+        uint32_t getFileId(StringRef file);
+        LocationKey getLocationKey(Instruction const* I);
+        std::optional<uint32_t> getReferenceCounter(Instruction const* I); // Coverage counter if I is at a relevant reference location
+        StringMap<uint32_t> file_ids;
+        std::vector<std::string> file_names; // Indexed by file id
+        DenseMap<DIFile const*, uint32_t> difile_ids;
+        DenseMap<LocationKey, uint32_t> reference_locations; // Same counters as reference_counters
+
+        // Fortran debug info, queried once per global and function
+        struct ParamDebugInfo {
+            uint64_t size_bits;
+            bool is_array; // Allocatable or pointer buffer, passed by descriptor
+        };
+        bool isArrayDescriptor(GlobalVariable const* GV);
+        std::vector<ParamDebugInfo> const& getParamDebugInfo(Function const* F); // Without the return value
+        DenseMap<GlobalVariable const*, bool> array_descriptors;
+        DenseMap<Function const*, std::vector<ParamDebugInfo>> param_debug_info;
         std::unordered_set<Instruction*> instrument_ignore;
+        std::unique_ptr<SpecialCaseList> ignorelist;
+        std::unique_ptr<SpecialCaseList> allowlist;
+        DenseMap<Function const*, bool> excluded_functions;
+        StringSet<> profile_files; // Source files instrumented in the training run
+        StringSet<> profile_hot_sites; // "read|write <file>:<line>:<column>" of sites accessed during a release window
 
         ContractManagerAnalysis::ContractDatabase* DB;
 };
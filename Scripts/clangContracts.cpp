@@ -49,14 +49,57 @@ static cl::opt<std::string> GenerateJSONReport("generate-json-report",
     cl::value_desc("JSON output path"),
     cl::cat(WrapperCategory));
 
-// String option with ValueOptional to handle "full", "funconly", and "filtered=path.json"
+// String option with ValueOptional to handle "full", "funconly", "filtered=path.json" and "profile=path"
 static cl::opt<std::string> InstrumentContracts("instrument-contracts",
     cl::desc("Perform instrumentation for runtime analysis.\n"
              "  full: Full instrumentation (default if instrumenting)\n"
              "  funconly: Disable costly memory instrumentation\n"
-             "  filtered[=<detection json>]: Only instrument potential issues from static analysis."),
+             "  filtered[=<detection json>]: Only instrument potential issues from static analysis.\n"
+             "  profile=<profile>: Only instrument memory accesses seen during release windows in a run with COVER_PROFILE_OUT=<profile>."),
     cl::ValueOptional,
-    cl::value_desc("(full|funconly|filtered)"),
+    cl::value_desc("(full|funconly|filtered|profile)"),
+    cl::cat(WrapperCategory));
+
+static cl::opt<std::string> CloneCleanFunctions("clone-clean-functions",
+    cl::desc("Keep uninstrumented copies of hot functions, used while no buffer is watched.\n"
+             "Optionally limit the code size increase in percent (default 20)"),
+    cl::ValueOptional,
+    cl::value_desc("size limit"),
+    cl::cat(WrapperCategory));
+
+static cl::opt<bool> RestrictToRegions("restrict-to-regions",
+    cl::desc("Only instrument memory accesses that may execute between a supplier call and its release"),
+    cl::cat(WrapperCategory));
+
+static cl::opt<std::string> InstrumentWrappers("instrument-wrappers",
+    cl::desc("Instrument calls to contract functions in one wrapper per function instead of at each callsite.\n"
+             "  redirect: Redirect callsites to the wrappers\n"
+             "  interpose: Also define MPI functions, forwarding to their PMPI symbol"),
+    cl::value_desc("(redirect|interpose)"),
+    cl::cat(WrapperCategory));
+
+static cl::opt<std::string> InstrumentReport("instrument-report",
+    cl::desc("Report the inserted callbacks per function and their estimated dynamic count. Path defaults to instrument_report.json"),
+    cl::ValueOptional,
+    cl::value_desc("JSON output path"),
+    cl::cat(WrapperCategory));
+
+static cl::list<std::string> Ignorelist("ignorelist",
+    cl::desc("Do not instrument the functions, source files and modules matched by the given special case list"),
+    cl::value_desc("file"),
+    cl::cat(WrapperCategory));
+
+static cl::list<std::string> Allowlist("allowlist",
+    cl::desc("Only instrument the functions, source files and modules matched by the given special case list"),
+    cl::value_desc("file"),
+    cl::cat(WrapperCategory));
+
+static cl::opt<bool> SampleMemory("sample-memory",
+    cl::desc("Only check a sample of memory accesses, adjusted at runtime to the overhead budget set by COVER_OVERHEAD_BUDGET"),
+    cl::cat(WrapperCategory));
+
+static cl::opt<bool> NoFastPaths("no-fast-paths",
+    cl::desc("Do not inline the fast paths of memory callbacks into instrumented code"),
     cl::cat(WrapperCategory));
 
 static cl::list<std::string> CompilerParams(cl::Sink,
@@ -71,6 +114,7 @@ LinkKind cur_linkkind = LinkKind::LINK;
 
 std::string dest_arg;
 std::string opt_level;
+bool link_shared = false;
 
 std::regex const link_file_ending(".*(\\.a|\\.so)");
 
@@ -127,8 +171,19 @@ std::pair<std::string,std::string> parseWrapperParams(std::pair<std::string,std:
     if (AllowMultiReports) opt_flags += " -cover-allow-multireports=1";
 
     if (InstrumentContracts.getNumOccurrences() && InstrumentContracts.empty()) InstrumentContracts = "full";
+    if (InstrumentContracts.starts_with("profile=")) InstrumentContracts = "profile=" + std::filesystem::absolute(InstrumentContracts.substr(8)).string();
     if (!InstrumentContracts.empty()) opt_flags += " -cover-instrument-type=\"" + InstrumentContracts + "\"";
 
+    if (CloneCleanFunctions.getNumOccurrences()) opt_flags += " -cover-clone-clean-functions=1";
+    if (!CloneCleanFunctions.empty()) opt_flags += " -cover-clone-size-limit=" + CloneCleanFunctions;
+    if (RestrictToRegions) opt_flags += " -cover-restrict-to-regions=1";
+    for (std::string const& list : Ignorelist) opt_flags += " -cover-ignorelist=\"" + std::filesystem::absolute(list).string() + "\"";
+    for (std::string const& list : Allowlist) opt_flags += " -cover-allowlist=\"" + std::filesystem::absolute(list).string() + "\"";
+    if (InstrumentReport.getNumOccurrences() && InstrumentReport.empty()) InstrumentReport = "instrument_report.json";
+    if (!InstrumentReport.empty()) opt_flags += " -cover-instrument-report=\"" + InstrumentReport + "\"";
+    if (SampleMemory) opt_flags += " -cover-sample-memory=1";
+    if (!InstrumentWrappers.empty()) opt_flags += " -cover-instrument-wrappers=" + InstrumentWrappers;
+
     if (GenerateJSONReport.getNumOccurrences() && GenerateJSONReport.empty()) GenerateJSONReport = "contract_messages.json";
     if (!GenerateJSONReport.empty()) opt_flags += " -cover-generate-json-report=" + GenerateJSONReport;
 
@@ -165,6 +220,9 @@ std::pair<std::string,std::string> parseCompilerParams(std::vector<std::string>
             rem_args_compile += " " + arg + " " + all_args[++i];
         } else if (arg.starts_with("-O")) {
             opt_level = arg;
+        } else if (arg == "-shared") {
+            link_shared = true;
+            rem_args_link += " " + arg;
         } else {
             rem_args_link += " " + arg;
             rem_args_compile += " " + arg;
@@ -279,6 +337,11 @@ int main(int argc, const char** argv) {
         bitcode_files += " " + destination;
     }
 
+    // Fast paths of the runtime are linked as bitcode by the instrumentation pass, so that they can be inlined into instrumented code
+    std::string fast_path_bc = "@COVER_FAST_PATH_PATH@";
+    bool const use_fast_paths = !InstrumentContracts.empty() && !NoFastPaths && !fast_path_bc.empty();
+    if (use_fast_paths) opt_flags += " -cover-fast-path-bitcode=\"" + fast_path_bc + "\"";
+
     // Perform link and analysis steps
     std::string tmpfile = std::filesystem::temp_directory_path().string() + "/contrPlugin_XXXXXX";
     int fd = mkstemp(tmpfile.data());
@@ -292,8 +355,10 @@ int main(int argc, const char** argv) {
     if (!InstrumentContracts.empty()) {
         // Need instrumentation, so add instr pass...
         passlist += ",instrumentContracts";
-        // ...and link against analyser. Need to hackily link against stdlib as well for C code
-        rem_args.first += " -Wl,--whole-archive @COVER_DYNAMIC_ANALYSER_PATH@ -Wl,-no-whole-archive -lstdc++";
+        if (use_fast_paths) passlist += ",always-inline";
+        // ...and link executables against analyser. Need to hackily link against stdlib as well for C code
+        // Callbacks are exported, so that instrumented shared libraries, which leave them undefined, use the runtime of the executable
+        if (!link_shared) rem_args.first += " -Wl,--whole-archive @COVER_DYNAMIC_ANALYSER_PATH@ -Wl,-no-whole-archive -lstdc++ '-Wl,--export-dynamic-symbol=PPDCV_*'";
     }
     execSafe("opt --load-pass-plugin=\"@DSA_PLUGIN_PATH@\" --load-pass-plugin \"@CONTR_PLUGIN_PATH@\" -passes='" + passlist + "' " + opt_flags + " " + tmpfile + " -o " + tmpfile + ".opt");
     close(fd);
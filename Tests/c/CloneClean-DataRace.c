@@ -0,0 +1,57 @@
+// RUN: %clangContracts --predefined-contracts --instrument-contracts --clone-clean-functions %s -o %t.exe 2>&1 | tee %t.test_out && (COVER_COVERAGE_FOLDER='%t_coverage' mpiexec -np 2 %t.exe >> %t.test_out 2>&1 || true) && FileCheck %s < %t.test_out
+// RUN: llvm-objdump -d %t.exe | FileCheck --check-prefix=DISPATCH %s
+
+#include <stdlib.h>
+#include <mpi.h>
+
+__attribute__((noinline)) void write_buf(int* buf) {
+    *buf = 24;
+}
+
+__attribute__((noinline)) int add(int* a, int* b) {
+    return *a + *b;
+}
+
+// Only calls clean functions, so it can run uninstrumented as well
+__attribute__((noinline)) int double_sum(int* buf) {
+    return buf[0] + buf[1] + add(&buf[0], &buf[1]);
+}
+
+int main(int argc, char** argv) {
+    int rank;
+    int* buf;
+    MPI_Request req;
+
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    buf = (int*)malloc(2 * sizeof(int));
+    buf[0] = 42;
+    buf[1] = double_sum(buf);
+    write_buf(buf);
+    if (rank == 0) {
+        MPI_Isend(buf, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, &req);
+        write_buf(buf);
+    } else {
+        MPI_Irecv(buf, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &req);
+    }
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+    MPI_Finalize();
+    return 0;
+}
+
+// CHECK-LABEL: Running Contract Manager on Module
+// CHECK: CoVer: Total Tool Runtime
+// CHECK: CoVer: Created uninstrumented copies of {{[1-9][0-9]*}} of {{[0-9]+}} functions with memory callbacks
+
+// CHECK-LABEL: CoVer-Dynamic: Initializing...
+// CHECK: Contract violation detected!
+// CHECK: Local Data Race - Local write
+// Dont check for analysis finished, MPI implementation might crash.
+
+// double_sum calls a function, but is cloned as its callee does not change the watched buffers
+// DISPATCH-LABEL: <double_sum>:
+// DISPATCH-NOT: >:
+// DISPATCH: <double_sum.cover_clean>
@@ -0,0 +1,46 @@
+// RUN: rm -rf %t_coverage && %clangContracts %run_common
+// RUN: cat %t_coverage/CoVerCoverage_* | FileCheck --check-prefix=COVERAGE %s
+
+#include <stdlib.h>
+#include <mpi.h>
+
+int main(int argc, char** argv) {
+    int rank;
+    int* in;
+    MPI_Request req;
+
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    in = (int*)malloc(sizeof(int));
+    in[0] = 42;
+    for (int i = 0; i < 300; i++) {
+        if (rank == 0) {
+            MPI_Isend(in, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, &req);
+        } else {
+            MPI_Irecv(in, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &req);
+        }
+        // Never executed, makes the calls above relevant locations
+        if (argc > 1) in[0] = 0;
+        MPI_Wait(&req, MPI_STATUS_IGNORE);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
+
+// CHECK-LABEL: Running Contract Manager on Module
+// CHECK: Contract violation detected!
+// CHECK: Local Data Race - Local write
+// CHECK: CoVer: Total Tool Runtime
+
+// CHECK-LABEL: CoVer-Dynamic: Initializing...
+// CHECK-NOT: Contract violation detected!
+// CHECK: Analysis finished.
+
+// Counters saturate instead of wrapping around, unvisited locations are not written
+// COVERAGE-NOT: Coverage-SaturatedCounts.c:25|
+// COVERAGE-DAG: @{{.*}}Coverage-SaturatedCounts.c:20|255
+// COVERAGE-DAG: @{{.*}}Coverage-SaturatedCounts.c:22|255
+// COVERAGE-NOT: Coverage-SaturatedCounts.c:25|
@@ -0,0 +1,54 @@
+// RUN: %clangContracts %run_common
+
+#include <stdlib.h>
+#include <mpi.h>
+
+int main(int argc, char** argv) {
+    int rank;
+    int* buf1;
+    int* buf2;
+    MPI_Request req1;
+    MPI_Request req2;
+
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    buf1 = (int*)malloc(sizeof(int));
+    buf2 = (int*)malloc(sizeof(int));
+    buf1[0] = 42;
+    buf2[0] = 43;
+    // The same callsite is pending again in each iteration
+    for (int i = 0; i < 3; i++) {
+        if (rank == 0) {
+            MPI_Isend(buf1, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, &req1);
+        } else {
+            MPI_Irecv(buf1, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &req1);
+        }
+        MPI_Wait(&req1, MPI_STATUS_IGNORE);
+    }
+    if (rank == 0) {
+        MPI_Isend(buf2, 1, MPI_INT, 1, 1, MPI_COMM_WORLD, &req2);
+        *buf1 = 24;
+        *buf2 = 34;
+    } else {
+        MPI_Irecv(buf2, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, &req2);
+    }
+    MPI_Wait(&req2, MPI_STATUS_IGNORE);
+
+    MPI_Finalize();
+    return 0;
+}
+
+// CHECK-LABEL: Running Contract Manager on Module
+// CHECK: CoVer: Total Tool Runtime
+
+// Each callsite keeps its own pending state, released by its last Wait
+// CHECK-LABEL: CoVer-Dynamic: Initializing...
+// CHECK-NOT: Reference: {{.*}}DenseIds-DataRace.c:32
+// CHECK: Contract violation detected!
+// CHECK: Local Data Race - Local write
+// CHECK: Reference: {{.*}}DenseIds-DataRace.c:31
+// CHECK: Reference: {{.*}}DenseIds-DataRace.c:33
+// CHECK-NOT: Reference: {{.*}}DenseIds-DataRace.c:32
+// Dont check for analysis finished, MPI implementation might crash.
@@ -0,0 +1,46 @@
+// RUN: %clangContracts %run_common
+
+#include <stdlib.h>
+#include <mpi.h>
+
+// scratch never escapes, so its accesses cannot touch a watched buffer
+__attribute__((noinline)) int pick(int rank) {
+    int scratch[4];
+    for (int i = 0; i < 4; i++) scratch[i] = 24 + i;
+    return scratch[rank % 4];
+}
+
+int main(int argc, char** argv) {
+    int rank;
+    int* buf;
+    MPI_Request req;
+
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    buf = (int*)malloc(sizeof(int));
+    buf[0] = 42;
+    if (rank == 0) {
+        MPI_Isend(buf, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, &req);
+        *buf = pick(rank);
+    } else {
+        MPI_Irecv(buf, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &req);
+    }
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+    MPI_Finalize();
+    return 0;
+}
+
+// CHECK-LABEL: Running Contract Manager on Module
+// CHECK: Contract violation detected!
+// CHECK: Local Data Race - Local write
+// CHECK: CoVer: Total Tool Runtime
+// CHECK: CoVer: Elided callbacks for {{[1-9][0-9]*}} of {{[0-9]+}} memory accesses ({{[0-9]+}} without read!/write! contract, {{[1-9][0-9]*}} to unwatched objects)
+
+// The race on buf is still found
+// CHECK-LABEL: CoVer-Dynamic: Initializing...
+// CHECK: Contract violation detected!
+// CHECK: Local Data Race - Local write
+// Dont check for analysis finished, MPI implementation might crash.
@@ -0,0 +1,55 @@
+// RUN: %clangContracts --predefined-contracts --instrument-contracts --no-fast-paths %s -o %t.exe 2>&1 | tee %t.test_out && (COVER_CALLBACK_STATS=1 COVER_COVERAGE_FOLDER='%t_coverage' mpiexec -np 2 %t.exe >> %t.test_out 2>&1 || true) && FileCheck %s < %t.test_out
+
+#include <stdlib.h>
+#include <mpi.h>
+
+int main(int argc, char** argv) {
+    int rank;
+    int* in;
+    int* other;
+    MPI_Request req;
+
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    in = (int*)malloc(sizeof(int));
+    other = (int*)malloc(sizeof(int));
+    // Nothing is watched yet, gated
+    in[0] = 42;
+    other[0] = 0;
+    if (rank == 0) {
+        MPI_Isend(in, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, &req);
+    } else {
+        MPI_Irecv(in, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &req);
+    }
+    // in is watched for writes on both ranks, reaches the runtime
+    other[0] = 1;
+    // Never executed, keeps the contracts from being proven statically
+    if (argc > 1) in[0] = 0;
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+    // Released again, gated
+    in[0] = in[0] + other[0];
+    other[0] = in[0];
+
+    if (rank == 0) {
+        MPI_Isend(other, 1, MPI_INT, 1, 1, MPI_COMM_WORLD, &req);
+    } else {
+        MPI_Irecv(other, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, &req);
+    }
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+    MPI_Finalize();
+    return 0;
+}
+
+// CHECK-LABEL: Running Contract Manager on Module
+// CHECK: CoVer: Total Tool Runtime
+
+// Only the write while a buffer is watched passes the gates
+// CHECK-LABEL: CoVer-Dynamic: Initializing...
+// CHECK-NOT: Contract violation detected!
+// CHECK-COUNT-2: Memory callbacks reaching the runtime: {{[0-9]+}} reads, 1 writes, 0 range reads, 0 range writes
+// CHECK-NOT: Contract violation detected!
+// CHECK: Analysis finished.
@@ -0,0 +1,58 @@
+// RUN: %clangContracts --predefined-contracts --instrument-contracts --no-fast-paths -O1 %s -o %t.exe 2>&1 | tee %t.test_out && (COVER_CALLBACK_STATS=1 COVER_COVERAGE_FOLDER='%t_coverage' mpiexec -np 2 %t.exe >> %t.test_out 2>&1 || true) && FileCheck %s < %t.test_out
+
+#include <stdlib.h>
+#include <mpi.h>
+
+#define N 1000
+
+__attribute__((noinline)) void fill(int* buf, int n) {
+    for (int i = 0; i < n; i++) buf[i] = i;
+}
+
+int main(int argc, char** argv) {
+    int rank;
+    int* in;
+    int* buf;
+    MPI_Request req;
+
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    in = (int*)malloc(sizeof(int));
+    buf = (int*)malloc(N * sizeof(int));
+    in[0] = 42;
+    if (rank == 0) {
+        MPI_Isend(in, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, &req);
+    } else {
+        MPI_Irecv(in, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &req);
+    }
+    // Runs while a buffer is watched
+    fill(buf, N);
+    // Never executed, keeps the contracts from being proven statically
+    if (argc > 1) in[0] = 0;
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+    // Passing buf to MPI makes the accesses in fill possibly watched
+    if (rank == 0) {
+        MPI_Isend(buf, N, MPI_INT, 1, 1, MPI_COMM_WORLD, &req);
+    } else {
+        MPI_Irecv(buf, N, MPI_INT, 0, 1, MPI_COMM_WORLD, &req);
+    }
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+    MPI_Finalize();
+    return 0;
+}
+
+// CHECK-LABEL: Running Contract Manager on Module
+// CHECK: CoVer: Total Tool Runtime
+// CHECK: CoVer: Replaced {{[1-9][0-9]*}} memory access callbacks in loops by range callbacks
+
+// Loops are only hoisted in rotated form, so -O1 is needed. The loop in fill calls
+// back once per unrolled access instead of once per iteration
+// CHECK-LABEL: CoVer-Dynamic: Initializing...
+// CHECK-NOT: Contract violation detected!
+// CHECK-COUNT-2: Memory callbacks reaching the runtime: {{[0-9]+}} reads, {{[0-9]}} writes, {{[0-9]+}} range reads, {{[1-9]}} range writes
+// CHECK-NOT: Contract violation detected!
+// CHECK: Analysis finished.
@@ -0,0 +1,47 @@
+// RUN: echo 'fun:*write_buf*' > %t.ignorelist && %clangContracts --predefined-contracts --instrument-contracts --ignorelist=%t.ignorelist %s -o %t.exe 2>&1 | tee %t.test_out && (COVER_COVERAGE_FOLDER='%t_coverage' mpiexec -np 2 %t.exe >> %t.test_out 2>&1 || true) && FileCheck %s < %t.test_out
+// RUN: llvm-objdump -d %t.exe | FileCheck --check-prefix=IGNORED %s
+
+#include <stdlib.h>
+#include <mpi.h>
+
+__attribute__((noinline)) void write_buf(int* buf) {
+    *buf = 24;
+}
+
+int main(int argc, char** argv) {
+    int rank;
+    int* buf;
+    MPI_Request req;
+
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    buf = (int*)malloc(sizeof(int));
+    buf[0] = 42;
+    if (rank == 0) {
+        MPI_Isend(buf, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, &req);
+        write_buf(buf);
+    } else {
+        MPI_Irecv(buf, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &req);
+    }
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+    MPI_Finalize();
+    return 0;
+}
+
+// CHECK-LABEL: Running Contract Manager on Module
+// CHECK: CoVer: Total Tool Runtime
+// CHECK: CoVer: Excluded 1 functions from instrumentation by ignorelist and allowlist
+
+// CHECK-LABEL: CoVer-Dynamic: Initializing...
+// CHECK-NOT: Contract violation detected!
+// CHECK: Analysis finished.
+
+// The ignored function references no callback, gate or fast path, unlike main
+// IGNORED-LABEL: <write_buf>:
+// IGNORED-NOT: PPDCV_
+// IGNORED: ret
+// IGNORED-LABEL: <main>:
+// IGNORED: PPDCV_
@@ -0,0 +1,51 @@
+// RUN: %clangContracts %run_common
+
+#include <stdlib.h>
+#include <mpi.h>
+
+int main(int argc, char** argv) {
+    int rank;
+    int* buf1;
+    int* buf2;
+    MPI_Request req1;
+    MPI_Request req2;
+
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    buf1 = (int*)malloc(sizeof(int));
+    buf2 = (int*)malloc(sizeof(int));
+    buf1[0] = 42;
+    buf2[0] = 43;
+    if (rank == 0) {
+        MPI_Isend(buf1, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, &req1);
+        MPI_Isend(buf2, 1, MPI_INT, 1, 1, MPI_COMM_WORLD, &req2);
+        MPI_Wait(&req1, MPI_STATUS_IGNORE);
+        // Only the request of buf1 was completed
+        *buf1 = 24;
+        *buf2 = 34;
+    } else {
+        MPI_Irecv(buf1, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &req1);
+        MPI_Irecv(buf2, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, &req2);
+        MPI_Wait(&req1, MPI_STATUS_IGNORE);
+    }
+    MPI_Wait(&req2, MPI_STATUS_IGNORE);
+
+    MPI_Finalize();
+    return 0;
+}
+
+// CHECK-LABEL: Running Contract Manager on Module
+// CHECK: CoVer: Total Tool Runtime
+
+// Buffers and requests are only passed as the parameters contracts refer to,
+// and must arrive at their original indices to match Isend with its Wait
+// CHECK-LABEL: CoVer-Dynamic: Initializing...
+// CHECK-NOT: Reference: {{.*}}ParamMap-DataRace.c:26
+// CHECK: Contract violation detected!
+// CHECK: Local Data Race - Local write
+// CHECK: Reference: {{.*}}ParamMap-DataRace.c:23
+// CHECK: Reference: {{.*}}ParamMap-DataRace.c:27
+// CHECK-NOT: Reference: {{.*}}ParamMap-DataRace.c:26
+// Dont check for analysis finished, MPI implementation might crash.
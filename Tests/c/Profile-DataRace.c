@@ -0,0 +1,44 @@
+// RUN: rm -f %t.profile && %clangContracts --predefined-contracts --instrument-contracts %s -o %t.train > /dev/null 2>&1 && (COVER_PROFILE_OUT=%t.profile COVER_COVERAGE_FOLDER='%t_coverage' mpiexec -np 2 %t.train > /dev/null 2>&1 || true)
+// RUN: FileCheck --check-prefix=PROFILE %s < %t.profile
+// RUN: %clangContracts --predefined-contracts --instrument-contracts=profile=%t.profile %s -o %t.exe 2>&1 | tee %t.test_out && (COVER_COVERAGE_FOLDER='%t_coverage' mpiexec -np 2 %t.exe >> %t.test_out 2>&1 || true) && FileCheck %s < %t.test_out
+
+#include <stdlib.h>
+#include <mpi.h>
+
+int main(int argc, char** argv) {
+    int rank;
+    int* buf;
+    MPI_Request req;
+
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    buf = (int*)malloc(sizeof(int));
+    buf[0] = 42;
+    if (rank == 0) {
+        MPI_Isend(buf, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, &req);
+        *buf = 24;
+    } else {
+        MPI_Irecv(buf, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &req);
+    }
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+    MPI_Finalize();
+    return 0;
+}
+
+// CHECK-LABEL: Running Contract Manager on Module
+// CHECK: CoVer: Total Tool Runtime
+// CHECK: CoVer: Read profile with {{[1-9][0-9]*}} memory sites accessed during release windows in 1 source files
+// CHECK: CoVer: Elided callbacks for {{[0-9]+}} memory accesses never accessed during a release window in the training profile
+
+// CHECK-LABEL: CoVer-Dynamic: Initializing...
+// CHECK: Contract violation detected!
+// CHECK: Local Data Race - Local write
+
+// Only the write while buf is watched is hot, the initialization is not
+// PROFILE: file {{.*}}Profile-DataRace.c
+// PROFILE-NOT: Profile-DataRace.c:18:
+// PROFILE: write {{.*}}Profile-DataRace.c:21:
+// PROFILE-NOT: Profile-DataRace.c:18:
@@ -0,0 +1,44 @@
+// RUN: %clangContracts %run_common
+// RUN: (COVER_CONTRACT_INCLUDE='Missing Initialization call' COVER_COVERAGE_FOLDER='%t_coverage_init' mpiexec -np 2 %t.exe 2>&1 || true) | FileCheck --check-prefix=INIT %s
+
+#include <stdlib.h>
+#include <mpi.h>
+
+int main(int argc, char** argv) {
+    int rank;
+    int* buf;
+    MPI_Request req;
+
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    buf = (int*)malloc(sizeof(int));
+    buf[0] = 42;
+    if (rank == 0) {
+        MPI_Isend(buf, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, &req);
+        *buf = 24;
+    } else {
+        MPI_Irecv(buf, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &req);
+    }
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+    MPI_Finalize();
+    return 0;
+}
+
+// CHECK-LABEL: Running Contract Manager on Module
+// CHECK: Contract violation detected!
+// CHECK: Local Data Race - Local write
+// CHECK: CoVer: Total Tool Runtime
+// CHECK: CoVer: Avoided {{[1-9][0-9]*}} runtime analyses for statically fulfilled formulas ({{[1-9][0-9]*}} contracts fully fulfilled)
+
+// The violated formula is still checked
+// CHECK-LABEL: CoVer-Dynamic: Initializing...
+// CHECK: Contract violation detected!
+// CHECK: Local Data Race - Local write
+// Dont check for analysis finished, MPI implementation might crash.
+
+// MPI_Init is called before every MPI call, so no initialization formula is left
+// INIT-COUNT-2: Registered 0 analyses
+// INIT-NOT: Contract violation detected!
@@ -0,0 +1,43 @@
+// RUN: %clangContracts --predefined-contracts --instrument-contracts --instrument-report=%t.json %s -o %t.exe 2>&1 | tee %t.test_out && (COVER_COVERAGE_FOLDER='%t_coverage' mpiexec -np 2 %t.exe >> %t.test_out 2>&1 || true) && FileCheck %s < %t.test_out && FileCheck --check-prefix=JSON %s < %t.json
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+
+int main(int argc, char** argv) {
+    int rank;
+    int* buf;
+    MPI_Request req;
+
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    buf = (int*)malloc(sizeof(int));
+    buf[0] = 42;
+    if (rank == 0) {
+        MPI_Isend(buf, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, &req);
+        printf("Buf: %d", buf[0]);
+    } else {
+        MPI_Irecv(buf, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &req);
+    }
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+    MPI_Finalize();
+    return 0;
+}
+
+// CHECK-LABEL: Running Contract Manager on Module
+// CHECK-NOT: Contract violation detected!
+// CHECK: CoVer: Total Tool Runtime
+// CHECK: CoVer: Instrumentation report (loop weight 10, written to {{.*}}.json)
+// CHECK: Function{{ +}}Function{{ +}}Read{{ +}}Write{{ +}}Relevant{{ +}}Est. dynamic
+// CHECK: main
+// CHECK: <total>
+
+// CHECK-LABEL: CoVer-Dynamic: Initializing...
+// CHECK-NOT: Contract violation detected!
+// CHECK: Analysis finished.
+
+// JSON: "function":"main"
+// JSON: "instrument_type":"full"
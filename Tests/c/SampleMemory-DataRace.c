@@ -0,0 +1,52 @@
+// RUN: %clangContracts --predefined-contracts --instrument-contracts --sample-memory --no-fast-paths %s -o %t.exe 2>&1 | tee %t.test_out && (COVER_OVERHEAD_BUDGET=0.001 COVER_COVERAGE_FOLDER='%t_coverage' mpiexec -np 2 %t.exe >> %t.test_out 2>&1 || true) && FileCheck %s < %t.test_out
+
+#include <stdlib.h>
+#include <mpi.h>
+
+int main(int argc, char** argv) {
+    int rank;
+    int* buf;
+    int* other;
+    MPI_Request req;
+
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    buf = (int*)malloc(sizeof(int));
+    other = (int*)malloc(sizeof(int));
+    buf[0] = 42;
+    if (rank == 0) {
+        MPI_Isend(buf, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, &req);
+        // Exceeds the budget, so that this site is checked less and less often
+        for (int i = 0; i < 100000; i++) other[0] = i;
+        *buf = 24;
+    } else {
+        MPI_Irecv(buf, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &req);
+    }
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+    if (rank == 0) {
+        MPI_Isend(other, 1, MPI_INT, 1, 1, MPI_COMM_WORLD, &req);
+    } else {
+        MPI_Irecv(other, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, &req);
+    }
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+    MPI_Finalize();
+    return 0;
+}
+
+// CHECK-LABEL: Running Contract Manager on Module
+// CHECK: Contract violation detected!
+// CHECK: Local Data Race - Local write
+// CHECK: CoVer: Total Tool Runtime
+// CHECK: CoVer: Sampling {{[1-9][0-9]*}} memory callback sites
+
+// The first access of each site is always checked, so the race is still found
+// CHECK-LABEL: CoVer-Dynamic: Initializing...
+// CHECK: Sampling memory accesses with an overhead budget of 0.001%
+// CHECK: Contract violation detected!
+// CHECK: Local Data Race - Local write
+// CHECK: Note: Memory accesses are checked by sampling, effective rate so far {{[0-9]{1,2}(\.[0-9]+)?}}%
+// Dont check for analysis finished, MPI implementation might crash.
@@ -0,0 +1,55 @@
+// RUN: %clangContracts --predefined-contracts --instrument-contracts -DCOVER_TEST_LIB -shared -fPIC %s -o %t.so > /dev/null 2>&1
+// RUN: %clangContracts --predefined-contracts --instrument-contracts %s -o %t.exe 2>&1 | tee %t.test_out && (COVER_COVERAGE_FOLDER='%t_coverage' mpiexec -np 2 %t.exe %t.so >> %t.test_out 2>&1 || true) && FileCheck %s < %t.test_out
+// RUN: llvm-nm -D %t.so | FileCheck --check-prefix=LIB %s
+
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <mpi.h>
+
+#ifdef COVER_TEST_LIB
+void send_buf(int* buf, MPI_Request* req) {
+    MPI_Isend(buf, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, req);
+}
+#else
+int main(int argc, char** argv) {
+    int rank;
+    int* buf;
+    MPI_Request req;
+    void* lib;
+    void (*send_buf)(int*, MPI_Request*);
+
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    // Loaded after the analysis started, so that the library registers its contracts with the running analysis
+    lib = dlopen(argv[1], RTLD_NOW);
+    if (!lib) return 1;
+    send_buf = (void (*)(int*, MPI_Request*))dlsym(lib, "send_buf");
+
+    buf = (int*)malloc(sizeof(int));
+    buf[0] = 42;
+    if (rank == 0) {
+        send_buf(buf, &req);
+        *buf = 24;
+    } else {
+        MPI_Irecv(buf, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &req);
+    }
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+    MPI_Finalize();
+    return 0;
+}
+#endif
+
+// CHECK-LABEL: Running Contract Manager on Module
+// CHECK: CoVer: Total Tool Runtime
+
+// CHECK-LABEL: CoVer-Dynamic: Initializing...
+// CHECK: Contract violation detected!
+// CHECK: Local Data Race - Local write
+// Dont check for analysis finished, MPI implementation might crash.
+
+// The library uses the runtime of the executable instead of its own copy
+// LIB-NOT: {{[BDRT]}} PPDCV_
+// LIB: T send_buf
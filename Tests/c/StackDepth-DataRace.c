@@ -0,0 +1,43 @@
+// RUN: %clangContracts --predefined-contracts --instrument-contracts %s -o %t.exe 2>&1 | tee %t.test_out && (COVER_STACK_DEPTH=4 COVER_COVERAGE_FOLDER='%t_coverage' mpiexec -np 2 %t.exe >> %t.test_out 2>&1 || true) && FileCheck %s < %t.test_out
+
+#include <stdlib.h>
+#include <mpi.h>
+
+__attribute__((noinline)) void send_buf(int* buf, MPI_Request* req) {
+    MPI_Isend(buf, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, req);
+}
+
+int main(int argc, char** argv) {
+    int rank;
+    int* buf;
+    MPI_Request req;
+
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    buf = (int*)malloc(sizeof(int));
+    buf[0] = 42;
+    if (rank == 0) {
+        send_buf(buf, &req);
+        *buf = 24;
+    } else {
+        MPI_Irecv(buf, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &req);
+    }
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+    MPI_Finalize();
+    return 0;
+}
+
+// CHECK-LABEL: Running Contract Manager on Module
+// CHECK: CoVer: Total Tool Runtime
+
+// CHECK-LABEL: CoVer-Dynamic: Initializing...
+// CHECK: Capturing call stacks of depth 4
+// CHECK: Contract violation detected!
+// CHECK: Local Data Race - Local write
+// The supplier call in send_buf is reported with its caller in main
+// CHECK: Reference: {{.*}}StackDepth-DataRace.c:7
+// CHECK-NEXT: Called from: {{.*}}StackDepth-DataRace.c:2{{[23]}}
+// Dont check for analysis finished, MPI implementation might crash.
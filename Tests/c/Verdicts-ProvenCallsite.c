@@ -0,0 +1,49 @@
+// RUN: %clangContracts --predefined-contracts --instrument-contracts --no-fast-paths %s -o %t.exe 2>&1 | tee %t.test_out && (COVER_CALLBACK_STATS=1 COVER_COVERAGE_FOLDER='%t_coverage' mpiexec -np 2 %t.exe >> %t.test_out 2>&1 || true) && FileCheck %s < %t.test_out
+
+#include <stdlib.h>
+#include <mpi.h>
+
+int main(int argc, char** argv) {
+    int rank;
+    int* in;
+    int* other;
+    MPI_Request req;
+
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    in = (int*)malloc(sizeof(int));
+    other = (int*)malloc(sizeof(int));
+    in[0] = 42;
+    other[0] = 0;
+    // Proven correct, so in is not watched
+    if (rank == 0) {
+        MPI_Isend(in, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, &req);
+    } else {
+        MPI_Irecv(in, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &req);
+    }
+    other[0] = 1;
+    MPI_Wait(&req, MPI_STATUS_IGNORE);
+
+    // Never executed, keeps the contracts from being proven statically
+    if (argc > 1) {
+        MPI_Isend(other, 1, MPI_INT, 1, 1, MPI_COMM_WORLD, &req);
+        other[0] = 2;
+        MPI_Wait(&req, MPI_STATUS_IGNORE);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
+
+// CHECK-LABEL: Running Contract Manager on Module
+// CHECK: CoVer: Total Tool Runtime
+// CHECK: CoVer: Passed static verdicts for {{[1-9][0-9]*}} supplier callsites
+
+// No buffer is watched, so the write to other does not pass the gates
+// CHECK-LABEL: CoVer-Dynamic: Initializing...
+// CHECK-NOT: Contract violation detected!
+// CHECK-COUNT-2: Memory callbacks reaching the runtime: {{[0-9]+}} reads, 0 writes, 0 range reads, 0 range writes
+// CHECK-NOT: Contract violation detected!
+// CHECK: Analysis finished.